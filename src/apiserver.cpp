@@ -0,0 +1,404 @@
+#include "apiserver.h"
+#include <QDateTime>
+#include <QFile>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+QByteArray statusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
+    }
+}
+
+QByteArray sseEvent(const QJsonObject &object) {
+    return "data: " + QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n\n";
+}
+
+QJsonObject errorObject(const QString &message, const QString &type) {
+    QJsonObject error;
+    error["message"]    = message;
+    error["type"]       = type;
+    return QJsonObject{{"error", error}};
+}
+
+} // namespace
+
+ApiServer::ApiServer(LlamaWorker *worker, const Options &options, QObject *parent)
+    : QObject(parent), worker(worker), options(options), streamTimer(new QTimer(this))
+{
+    streamTimer->setInterval(options.streamIntervalMs);
+    connect(streamTimer, &QTimer::timeout,                  this, &ApiServer::drainStream);
+    connect(worker,      &LlamaWorker::streamReady,         this, &ApiServer::drainStream);
+    connect(worker,      &LlamaWorker::responseGenerated,   this, &ApiServer::onResponse);
+    connect(worker,      &LlamaWorker::generationStats,     this, &ApiServer::onStats);
+    connect(worker,      &LlamaWorker::sessionError,        this, &ApiServer::onError);
+    connect(worker,      &LlamaWorker::generationCancelled, this, [this](int sessionId) { finish(sessionId); });
+    connect(worker,      &LlamaWorker::responseCacheStats,  this, [this](const ResponseCache::Stats &stats) { cacheStats = stats; });
+}
+
+bool ApiServer::listenTcp(quint16 port, QString *error) {
+    tcpServer = new QTcpServer(this);
+    if (!tcpServer->listen(QHostAddress::LocalHost, port)) {
+        *error = tcpServer->errorString();
+        return false;
+    }
+    connect(tcpServer, &QTcpServer::newConnection, this, [this]() {
+        while (QTcpSocket *socket = tcpServer->nextPendingConnection()) {
+            connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { onDisconnected(socket); });
+            addConnection(socket);
+        }
+    });
+    return true;
+}
+
+bool ApiServer::listenLocal(const QString &path, QString *error) {
+    QLocalServer::removeServer(path);
+    localServer = new QLocalServer(this);
+    localServer->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!localServer->listen(path)) {
+        *error = localServer->errorString();
+        return false;
+    }
+    connect(localServer, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket *socket = localServer->nextPendingConnection()) {
+            connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { onDisconnected(socket); });
+            addConnection(socket);
+        }
+    });
+    return true;
+}
+
+void ApiServer::addConnection(QIODevice *socket) {
+    incoming[socket];
+    connect(socket, &QIODevice::readyRead, this, [this, socket]() { onReadyRead(socket); });
+}
+
+void ApiServer::onReadyRead(QIODevice *socket) {
+    auto it = incoming.find(socket);
+    if (it == incoming.end()) {
+        socket->readAll();      // one request per connection, anything after it is ignored
+        return;
+    }
+    QByteArray &buffer = it->second;
+    buffer += socket->readAll();
+
+    const qsizetype headerEnd = buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+        if (buffer.size() > MAX_HEADER_BYTES) {
+            incoming.erase(it);
+            respondError(socket, 413, "Request headers too large", "invalid_request_error");
+        }
+        return;
+    }
+
+    const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+    const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    qint64 contentLength = 0;
+    for (qsizetype i = 1; i < lines.size(); ++i) {
+        const qsizetype colon = lines[i].indexOf(':');
+        if (colon > 0 && lines[i].left(colon).trimmed().toLower() == "content-length") {
+            contentLength = lines[i].mid(colon + 1).trimmed().toLongLong();
+        }
+    }
+
+    if (requestLine.size() < 2 || contentLength < 0 || contentLength > MAX_BODY_BYTES) {
+        incoming.erase(it);
+        respondError(socket, requestLine.size() < 2 ? 400 : 413, "Malformed or oversized request", "invalid_request_error");
+        return;
+    }
+    if (buffer.size() < headerEnd + 4 + contentLength) {
+        return;
+    }
+
+    const QByteArray body = buffer.mid(headerEnd + 4, contentLength);
+    incoming.erase(it);
+
+    // Query strings are not used by any endpoint.
+    const QByteArray path = requestLine[1].split('?').first();
+    route(socket, requestLine[0], path, body);
+}
+
+void ApiServer::route(QIODevice *socket, const QByteArray &method, const QByteArray &path, const QByteArray &body) {
+    if (path == "/v1/chat/completions") {
+        if (method != "POST") {
+            respondError(socket, 405, "Use POST", "invalid_request_error");
+            return;
+        }
+        submit(socket, body);
+    } else if (path == "/v1/models") {
+        QJsonObject model;
+        model["id"]         = options.modelName;
+        model["object"]     = "model";
+        model["owned_by"]   = "lunaria";
+        respond(socket, 200, QJsonObject{{"object", "list"}, {"data", QJsonArray{model}}});
+    } else if (path == "/health") {
+        QJsonObject health;
+        health["status"]    = "ok";
+        health["active"]    = activeCount;
+        health["queued"]    = int(queue.size());
+
+        QJsonObject cache;
+        cache["hits"]           = qint64(cacheStats.hits);
+        cache["misses"]         = qint64(cacheStats.misses);
+        cache["bytesSaved"]     = qint64(cacheStats.bytesSaved);
+        cache["tokensSaved"]    = qint64(cacheStats.tokensSaved);
+        cache["memoryBytes"]    = cacheStats.memoryBytes;
+        cache["diskBytes"]      = cacheStats.diskBytes;
+        health["responseCache"] = cache;
+        respond(socket, 200, health);
+    } else {
+        respondError(socket, 404, "Unknown endpoint " + QString::fromUtf8(path), "invalid_request_error");
+    }
+}
+
+void ApiServer::submit(QIODevice *socket, const QByteArray &body) {
+    // Refused before parsing, so a flood of requests costs as little as possible.
+    if (activeCount >= options.maxActive && int(queue.size()) >= options.maxQueued) {
+        respond(socket, 429, errorObject("Server is busy, retry later", "rate_limit_error"), "Retry-After: 1\r\n");
+        return;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(body, &parseError);
+    if (!document.isObject()) {
+        respondError(socket, 400, "Invalid JSON: " + parseError.errorString(), "invalid_request_error");
+        return;
+    }
+
+    Request request;
+    QString error;
+    if (!ChatRequest::fromJson(document.object(), options.defaults, options.maxTokensLimit, request.chat, &error)) {
+        respondError(socket, 400, error, "invalid_request_error");
+        return;
+    }
+
+    const int sessionId = nextSession++;
+    request.socket          = socket;
+    request.stream          = document.object().value("stream").toBool();
+    request.completionId    = "chatcmpl-" + QByteArray::number(sessionId);
+    request.created         = QDateTime::currentSecsSinceEpoch();
+    requests[sessionId]     = std::move(request);
+    sessionOf[socket]       = sessionId;
+    queue.push_back(sessionId);
+    startNext();
+}
+
+void ApiServer::startNext() {
+    while (activeCount < options.maxActive && !queue.empty()) {
+        const int sessionId = queue.front();
+        queue.pop_front();
+
+        Request &request = requests[sessionId];
+        request.active = true;
+        ++activeCount;
+
+        if (request.stream) {
+            request.socket->write("HTTP/1.1 200 OK\r\n"
+                                  "Content-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\n"
+                                  "Connection: close\r\n\r\n");
+            request.socket->write(chunk(request, QJsonObject{{"role", "assistant"}}, QJsonValue::Null));
+        }
+
+        const ChatHistory history = request.chat.history;
+        const GenerationSettings settings = request.chat.settings;
+        QMetaObject::invokeMethod(worker, [worker = worker, sessionId, history, settings]() {
+            worker->generateResponseWithMessages(sessionId, history, settings);
+        });
+    }
+
+    if (activeCount > 0 && !streamTimer->isActive()) {
+        streamTimer->start();
+    } else if (activeCount == 0) {
+        streamTimer->stop();
+    }
+}
+
+void ApiServer::drainStream() {
+    std::vector<int> lagging;
+    worker->tokenStream()->drain([&](int sessionId, const QString &text) {
+        auto it = requests.find(sessionId);
+        if (it == requests.end() || !it->second.stream || !it->second.socket) {
+            return;
+        }
+        QIODevice *socket = it->second.socket;
+        socket->write(chunk(it->second, QJsonObject{{"content", text}}, QJsonValue::Null));
+
+        // The worker can't be paused for one session, a client that doesn't
+        // keep up is dropped rather than buffered without limit.
+        if (socket->bytesToWrite() > options.maxUnsentBytes) {
+            lagging.push_back(sessionId);
+        }
+    });
+
+    for (int sessionId : lagging) {
+        QIODevice *socket = detach(requests[sessionId]);
+        worker->cancelGeneration(sessionId);
+        closeSocket(socket);
+    }
+}
+
+void ApiServer::onResponse(int sessionId, const QString &response) {
+    drainStream();
+    auto it = requests.find(sessionId);
+    if (it != requests.end()) {
+        it->second.response = response;
+    }
+}
+
+void ApiServer::onStats(int sessionId, const GenerationStats &stats) {
+    auto it = requests.find(sessionId);
+    if (it == requests.end()) {
+        return;
+    }
+    Request &request = it->second;
+    QIODevice *socket = detach(request);
+    const QString finishReason = stats.generatedTokens >= request.chat.settings.maxTokens ? "length" : "stop";
+
+    if (socket && request.stream) {
+        socket->write(chunk(request, QJsonObject(), finishReason));
+        socket->write("data: [DONE]\n\n");
+        closeSocket(socket);
+    } else if (socket) {
+        QJsonObject message;
+        message["role"]     = "assistant";
+        message["content"]  = request.response;
+
+        QJsonObject choice;
+        choice["index"]         = 0;
+        choice["message"]       = message;
+        choice["finish_reason"] = finishReason;
+
+        QJsonObject usage;
+        usage["prompt_tokens"]      = stats.promptTokens;
+        usage["completion_tokens"]  = stats.generatedTokens;
+        usage["total_tokens"]       = stats.promptTokens + stats.generatedTokens;
+
+        QJsonObject body;
+        body["id"]      = QString::fromLatin1(request.completionId);
+        body["object"]  = "chat.completion";
+        body["created"] = request.created;
+        body["model"]   = options.modelName;
+        body["choices"] = QJsonArray{choice};
+        body["usage"]   = usage;
+        respond(socket, 200, body);
+    }
+    finish(sessionId);
+}
+
+void ApiServer::onError(int sessionId, const QString &error) {
+    drainStream();
+    auto it = requests.find(sessionId);
+    if (it == requests.end()) {
+        return;
+    }
+    Request &request = it->second;
+    QIODevice *socket = detach(request);
+
+    if (socket && request.stream) {
+        socket->write(sseEvent(errorObject(error, "server_error")));
+        closeSocket(socket);
+    } else if (socket) {
+        respondError(socket, 500, error, "server_error");
+    }
+    finish(sessionId);
+}
+
+// Queued requests are dropped on the spot, active ones once the worker
+// confirms the cancellation.
+void ApiServer::onDisconnected(QIODevice *socket) {
+    incoming.erase(socket);
+    socket->deleteLater();
+
+    auto session = sessionOf.find(socket);
+    if (session == sessionOf.end()) {
+        return;
+    }
+    const int sessionId = session->second;
+    sessionOf.erase(session);
+
+    Request &request = requests[sessionId];
+    request.socket = nullptr;
+    if (request.active) {
+        worker->cancelGeneration(sessionId);
+    } else {
+        queue.erase(std::find(queue.begin(), queue.end(), sessionId));
+        requests.erase(sessionId);
+    }
+}
+
+// Closing a socket can report the disconnect right away, so the request lets
+// go of it first.
+QIODevice *ApiServer::detach(Request &request) {
+    QIODevice *socket = request.socket;
+    if (socket) {
+        sessionOf.erase(socket);
+        request.socket = nullptr;
+    }
+    return socket;
+}
+
+void ApiServer::finish(int sessionId) {
+    auto it = requests.find(sessionId);
+    if (it == requests.end()) {
+        return;
+    }
+    detach(it->second);
+    if (it->second.active) {
+        --activeCount;
+        QMetaObject::invokeMethod(worker, [worker = worker, sessionId]() { worker->closeSession(sessionId); });
+    }
+    worker->tokenStream()->reset(sessionId);
+    requests.erase(it);
+    startNext();
+}
+
+QByteArray ApiServer::chunk(const Request &request, const QJsonObject &delta, const QJsonValue &finishReason) const {
+    QJsonObject choice;
+    choice["index"]         = 0;
+    choice["delta"]         = delta;
+    choice["finish_reason"] = finishReason;
+
+    QJsonObject object;
+    object["id"]        = QString::fromLatin1(request.completionId);
+    object["object"]    = "chat.completion.chunk";
+    object["created"]   = request.created;
+    object["model"]     = options.modelName;
+    object["choices"]   = QJsonArray{choice};
+    return sseEvent(object);
+}
+
+void ApiServer::respond(QIODevice *socket, int status, const QJsonObject &body, const QByteArray &extraHeaders) {
+    const QByteArray json = QJsonDocument(body).toJson(QJsonDocument::Compact);
+    socket->write("HTTP/1.1 " + QByteArray::number(status) + " " + statusText(status) + "\r\n"
+                  "Content-Type: application/json\r\n"
+                  "Content-Length: " + QByteArray::number(json.size()) + "\r\n"
+                  + extraHeaders +
+                  "Connection: close\r\n\r\n" + json);
+    closeSocket(socket);
+}
+
+void ApiServer::respondError(QIODevice *socket, int status, const QString &message, const QString &type) {
+    respond(socket, status, errorObject(message, type));
+}
+
+// Both socket types flush what is still buffered before disconnecting.
+void ApiServer::closeSocket(QIODevice *socket) {
+    socket->close();
+}
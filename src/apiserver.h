@@ -0,0 +1,94 @@
+#ifndef APISERVER_H
+#define APISERVER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <deque>
+#include <map>
+#include "chatrequest.h"
+#include "llamaworker.h"
+
+class QIODevice;
+class QLocalServer;
+class QTcpServer;
+class QTimer;
+
+// OpenAI-compatible HTTP endpoint in front of a loaded LlamaWorker, on
+// loopback and/or a Unix socket. Each completion is its own worker session,
+// so up to maxActive of them are batched together; the rest wait in a queue
+// of at most maxQueued, beyond which requests get 429. One request per
+// connection, closing the connection cancels the request.
+//
+//   POST /v1/chat/completions   ChatRequest body, "stream": true for SSE
+//   GET  /v1/models
+//   GET  /health                active and queued requests, response cache counters
+class ApiServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int maxActive       = 4;        // at most the worker's maxSessions
+        int maxQueued       = 16;
+        int streamIntervalMs = 16;
+        qint64 maxUnsentBytes = 1 << 20;    // a streaming client this far behind is dropped
+        QString modelName;
+        GenerationSettings defaults;
+        int maxTokensLimit  = 8192;     // the context size, larger max_tokens get a 400
+    };
+
+    ApiServer(LlamaWorker *worker, const Options &options, QObject *parent = nullptr);
+
+    bool listenTcp(quint16 port, QString *error);
+    bool listenLocal(const QString &path, QString *error);
+
+private:
+    static constexpr qint64 MAX_HEADER_BYTES  = 64 * 1024;
+    static constexpr qint64 MAX_BODY_BYTES    = 16 * 1024 * 1024;
+
+    struct Request {
+        QIODevice *socket   = nullptr;  // null once the client is gone
+        ChatRequest chat;
+        bool stream         = false;
+        bool active         = false;
+        QByteArray completionId;
+        qint64 created      = 0;
+        QString response;
+    };
+
+    LlamaWorker *worker;
+    Options options;
+    QTcpServer *tcpServer       = nullptr;
+    QLocalServer *localServer   = nullptr;
+    QTimer *streamTimer;
+
+    std::map<QIODevice *, QByteArray> incoming;     // connections still sending their request
+    std::map<QIODevice *, int> sessionOf;
+    std::map<int, Request> requests;                // by session id
+    std::deque<int> queue;
+    int activeCount     = 0;
+    int nextSession     = 1;
+    ResponseCache::Stats cacheStats;
+
+    void addConnection(QIODevice *socket);
+    void onReadyRead(QIODevice *socket);
+    void onDisconnected(QIODevice *socket);
+    void route(QIODevice *socket, const QByteArray &method, const QByteArray &path, const QByteArray &body);
+    void submit(QIODevice *socket, const QByteArray &body);
+    void startNext();
+    void drainStream();
+
+    void onResponse(int sessionId, const QString &response);
+    void onStats(int sessionId, const GenerationStats &stats);
+    void onError(int sessionId, const QString &error);
+    void finish(int sessionId);
+    QIODevice *detach(Request &request);
+
+    QByteArray chunk(const Request &request, const QJsonObject &delta, const QJsonValue &finishReason) const;
+    static void respond(QIODevice *socket, int status, const QJsonObject &body, const QByteArray &extraHeaders = QByteArray());
+    static void respondError(QIODevice *socket, int status, const QString &message, const QString &type);
+    static void closeSocket(QIODevice *socket);
+};
+
+#endif // APISERVER_H
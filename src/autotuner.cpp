@@ -0,0 +1,162 @@
+#include "autotuner.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+#include <random>
+
+AutoTuner::AutoTuner(llama_model *model, const std::atomic<bool> &cancel, const PoolLayout &layout)
+    : model(model), cancel(cancel), layout(layout)
+{
+    // Random ids are fine, throughput doesn't depend on what the tokens say.
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<llama_token> dist(0, n_vocab - 1);
+
+    workload.resize(std::max(PREFILL_TOKENS * 2, 1024));
+    for (llama_token &token : workload) {
+        token = dist(rng);
+    }
+}
+
+std::vector<int> AutoTuner::threadCandidates() {
+    const int logical = std::max(1, QThread::idealThreadCount());
+
+    std::vector<int> candidates = {1, 2, 4, 6, 8, 12, 16, 24, 32, 48, 64};
+    candidates.push_back(std::max(1, logical / 2));     // one per physical core on SMT machines
+    candidates.push_back(logical);
+
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [&](int n) { return n > logical; }), candidates.end());
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
+
+bool AutoTuner::run(const Progress &progress, TuneResult &result) {
+    const std::vector<int> threads = threadCandidates();
+    const std::vector<int> batchSizes = {64, 128, 256, 512, 1024};
+    const int total = threads.size() + batchSizes.size();
+    int step = 0;
+
+    result = TuneResult();
+
+    // Threads first, at the default batch size.
+    llama_context *context = createContext(512, threads.back());
+    if (!context) {
+        return false;
+    }
+
+    for (int n : threads) {
+        if (cancel) {
+            llama_free(context);
+            return false;
+        }
+        progress(++step, total, QString("Measuring %1 threads").arg(n));
+
+        if (pools.create(n, n, layout)) {
+            pools.attach(context);
+        }
+        llama_set_n_threads(context, n, n);
+
+        double decode  = measureDecode(context);
+        double prefill = measurePrefill(context, PREFILL_TOKENS, 512);
+
+        if (decode > result.decodeTps) {
+            result.decodeTps   = decode;
+            result.threadCount = n;
+        }
+        if (prefill > result.prefillTps) {
+            result.prefillTps       = prefill;
+            result.batchThreadCount = n;
+        }
+    }
+    llama_free(context);
+
+    // Then batch sizes, with the best prompt processing thread count.
+    pools.create(result.batchThreadCount, result.batchThreadCount, layout);
+    result.prefillTps = 0.0;
+    for (int batchSize : batchSizes) {
+        if (cancel) {
+            return false;
+        }
+        progress(++step, total, QString("Measuring batch size %1").arg(batchSize));
+
+        context = createContext(batchSize, result.batchThreadCount);
+        if (!context) {
+            continue;
+        }
+
+        double prefill = measurePrefill(context, std::max(PREFILL_TOKENS, batchSize), batchSize);
+        llama_free(context);
+
+        // Larger batches cost more compute buffer memory, only take them for a real gain.
+        if (prefill > result.prefillTps * 1.05) {
+            result.prefillTps = prefill;
+            result.batchSize  = batchSize;
+        }
+    }
+
+    return result.batchSize > 0 && !cancel;
+}
+
+llama_context *AutoTuner::createContext(int batchSize, int threads) {
+    llama_context_params params = llama_context_default_params();
+    params.n_ctx            = workload.size() + DECODE_TOKENS;
+    params.n_batch          = batchSize;
+    params.n_ubatch         = batchSize;
+    params.n_seq_max        = 1;
+    params.n_threads        = threads;
+    params.n_threads_batch  = threads;
+    params.no_perf          = true;
+
+    llama_context *context = llama_init_from_model(model, params);
+    if (context) {
+        pools.attach(context);
+        llama_set_abort_callback(context, [](void *data) {
+            return static_cast<const std::atomic<bool> *>(data)->load();
+        }, const_cast<std::atomic<bool> *>(&cancel));
+    }
+    return context;
+}
+
+double AutoTuner::measurePrefill(llama_context *context, int n_tokens, int batchSize) {
+    llama_memory_clear(llama_get_memory(context), true);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < n_tokens; i += batchSize) {
+        int n_eval = std::min(batchSize, n_tokens - i);
+        if (llama_decode(context, llama_batch_get_one(workload.data() + i, n_eval)) != 0) {
+            return 0.0;
+        }
+    }
+    llama_synchronize(context);
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    return seconds > 0.0 ? n_tokens / seconds : 0.0;
+}
+
+double AutoTuner::measureDecode(llama_context *context) {
+    llama_memory_clear(llama_get_memory(context), true);
+
+    // Short prompt so attention cost is realistic, then one token per decode.
+    const int n_prompt = 16;
+    if (llama_decode(context, llama_batch_get_one(workload.data(), n_prompt)) != 0) {
+        return 0.0;
+    }
+    llama_synchronize(context);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < DECODE_TOKENS; ++i) {
+        if (llama_decode(context, llama_batch_get_one(workload.data() + n_prompt + i, 1)) != 0) {
+            return 0.0;
+        }
+    }
+    llama_synchronize(context);
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    return seconds > 0.0 ? DECODE_TOKENS / seconds : 0.0;
+}
@@ -0,0 +1,50 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "llama.h"
+#include "computepools.h"
+
+struct TuneResult {
+    int threadCount         = 0;        // decode
+    int batchThreadCount    = 0;        // prompt processing
+    int batchSize           = 0;
+    double decodeTps        = 0.0;
+    double prefillTps       = 0.0;
+};
+
+// Sweeps thread counts and batch sizes on a synthetic workload against a loaded
+// model, using throwaway contexts so live sessions are left alone. Decode and
+// prefill are timed separately since they scale differently: decode is memory
+// bound and usually slows down once hyperthreads join in, prefill is compute bound.
+class AutoTuner
+{
+public:
+    using Progress = std::function<void(int step, int total, const QString &what)>;
+
+    AutoTuner(llama_model *model, const std::atomic<bool> &cancel, const PoolLayout &layout);
+
+    // Returns false if cancelled or a context couldn't be created.
+    bool run(const Progress &progress, TuneResult &result);
+
+    static std::vector<int> threadCandidates();
+
+private:
+    static constexpr int PREFILL_TOKENS = 256;
+    static constexpr int DECODE_TOKENS  = 32;
+
+    llama_model *model;
+    const std::atomic<bool> &cancel;
+    PoolLayout layout;
+    ComputePools pools;                 // pinned like the live context's, or the numbers wouldn't carry over
+    std::vector<llama_token> workload;
+
+    llama_context *createContext(int batchSize, int threads);
+    double measurePrefill(llama_context *context, int n_tokens, int batchSize);
+    double measureDecode(llama_context *context);
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,69 @@
+#include "chathistory.h"
+#include <QStringEncoder>
+#include <algorithm>
+
+const char *TextArena::add(const QString &text, size_t *size) {
+    QStringEncoder encoder(QStringEncoder::Utf8);
+    const size_t need = encoder.requiredSpace(text.size()) + 1;
+
+    if (chunks.empty() || capacity - used < need) {
+        capacity = std::max(CHUNK_SIZE, need);
+        chunks.emplace_back(new char[capacity]);
+        used = 0;
+    }
+
+    // Encoded straight into the arena, no intermediate QByteArray.
+    char *begin = chunks.back().get() + used;
+    char *end   = encoder.appendToBuffer(begin, text);
+    *end = '\0';
+
+    *size = end - begin;
+    used += *size + 1;
+    return begin;
+}
+
+ChatHistory::ChatHistory()
+    : d(new Data)
+{
+    d->arena = std::make_shared<TextArena>();
+}
+
+void ChatHistory::append(const QString &role, const QString &content, bool pinned) {
+    Entry entry;
+    size_t roleSize;
+    entry.role      = d->arena->add(role, &roleSize);
+    entry.content   = d->arena->add(content, &entry.contentSize);
+    entry.pinned    = pinned;
+    entry.segment   = std::make_shared<Segment>();
+    d->entries.push_back(std::move(entry));
+}
+
+// The text stays in the arena until the history is cleared.
+void ChatHistory::removeLast() {
+    d->entries.pop_back();
+}
+
+// Snapshots still held elsewhere keep the old arena alive.
+void ChatHistory::clear() {
+    d = QSharedDataPointer<Data>(new Data);
+    d->arena = std::make_shared<TextArena>();
+}
+
+std::vector<ChatMessage> ChatHistory::messages() const {
+    std::vector<ChatMessage> result;
+    result.reserve(size());
+    for (const Entry &entry : d->entries) {
+        result.push_back({QString::fromUtf8(entry.role),
+                          QString::fromUtf8(entry.content, entry.contentSize),
+                          entry.pinned});
+    }
+    return result;
+}
+
+ChatHistory ChatHistory::fromMessages(const std::vector<ChatMessage> &messages) {
+    ChatHistory history;
+    for (const ChatMessage &message : messages) {
+        history.append(message.role, message.content, message.pinned);
+    }
+    return history;
+}
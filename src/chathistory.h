@@ -0,0 +1,83 @@
+#ifndef CHATHISTORY_H
+#define CHATHISTORY_H
+
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QString>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llama.h"
+
+struct ChatMessage {
+    QString role;
+    QString content;
+    bool pinned         = false;    // kept in context when older turns are evicted
+};
+
+// Append-only UTF-8 text, in chunks that never move once written, so
+// pointers handed out stay valid while more text is appended.
+class TextArena
+{
+public:
+    const char *add(const QString &text, size_t *size);
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t used     = 0;
+    size_t capacity = 0;
+};
+
+// A conversation's messages, converted to UTF-8 once when they are added.
+// Copies are implicitly shared snapshots, so passing one to the worker
+// copies no text; the arena is shared between them too, the GUI only
+// appends past what any snapshot refers to.
+class ChatHistory
+{
+public:
+    // The message's part of the rendered chat template and its tokens,
+    // filled in and only ever touched by the worker thread.
+    struct Segment {
+        QString key;                    // model the tokens belong to
+        std::string text;
+        std::vector<llama_token> tokens;
+    };
+
+    ChatHistory();
+
+    void append(const QString &role, const QString &content, bool pinned = false);
+    void removeLast();
+    void clear();
+
+    size_t size() const { return d->entries.size(); }
+    bool empty() const { return d->entries.empty(); }
+
+    // NUL-terminated, valid as long as a copy of this history is alive.
+    const char *role(size_t i) const { return d->entries[i].role; }
+    const char *content(size_t i) const { return d->entries[i].content; }
+    bool pinned(size_t i) const { return d->entries[i].pinned; }
+    Segment &segment(size_t i) const { return *d->entries[i].segment; }
+
+    std::vector<ChatMessage> messages() const;
+    static ChatHistory fromMessages(const std::vector<ChatMessage> &messages);
+
+private:
+    struct Entry {
+        const char *role;
+        const char *content;
+        size_t contentSize;
+        bool pinned;
+        std::shared_ptr<Segment> segment;
+    };
+
+    struct Data : QSharedData {
+        std::shared_ptr<TextArena> arena;
+        std::vector<Entry> entries;
+    };
+
+    QSharedDataPointer<Data> d;
+};
+
+#endif // CHATHISTORY_H
@@ -0,0 +1,43 @@
+#include "chatrequest.h"
+#include <QJsonArray>
+
+bool ChatRequest::fromJson(const QJsonObject &json, const GenerationSettings &defaults, int maxTokensLimit,
+                           ChatRequest &request, QString *error) {
+    request.history.clear();
+    request.settings = defaults;
+
+    if (json.value("messages").isArray()) {
+        for (const QJsonValue &value : json.value("messages").toArray()) {
+            const QJsonObject message = value.toObject();
+            const QString role = message.value("role").toString();
+            if (role.isEmpty() || !message.value("content").isString()) {
+                *error = "Each message needs a role and a string content";
+                return false;
+            }
+            request.history.append(role, message.value("content").toString());
+        }
+    } else if (json.value("prompt").isString()) {
+        request.history.append("user", json.value("prompt").toString());
+    }
+
+    if (request.history.empty()) {
+        *error = "Request has no messages";
+        return false;
+    }
+
+    GenerationSettings &settings = request.settings;
+    settings.maxTokens      = json.value("max_tokens").toInt(settings.maxTokens);
+    settings.temperature    = json.value("temperature").toDouble(settings.temperature);
+    settings.topP           = json.value("top_p").toDouble(settings.topP);
+    settings.topK           = json.value("top_k").toInt(settings.topK);
+
+    if (settings.maxTokens < 1 || settings.temperature < 0.0 || settings.topP <= 0.0 || settings.topP > 1.0) {
+        *error = "max_tokens, temperature or top_p out of range";
+        return false;
+    }
+    if (settings.maxTokens > maxTokensLimit) {
+        *error = QString("max_tokens is larger than the context (%1)").arg(maxTokensLimit);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef CHATREQUEST_H
+#define CHATREQUEST_H
+
+#include <QJsonObject>
+#include <QString>
+#include "chathistory.h"
+#include "llamaworker.h"
+
+// One chat completion request as JSON, in the OpenAI shape:
+//
+//   {"messages": [{"role": "user", "content": "..."}], "max_tokens": 256,
+//    "temperature": 0.7, "top_p": 0.9, "top_k": 40}
+//
+// A plain "prompt" string stands in for a single user message. Settings not
+// given keep the values from `defaults`. max_tokens above `maxTokensLimit` is
+// rejected, with context shift on a request could otherwise generate forever.
+struct ChatRequest {
+    ChatHistory history;
+    GenerationSettings settings;
+
+    static bool fromJson(const QJsonObject &json, const GenerationSettings &defaults, int maxTokensLimit,
+                         ChatRequest &request, QString *error);
+};
+
+#endif // CHATREQUEST_H
@@ -0,0 +1,85 @@
+#include "computepools.h"
+#include <algorithm>
+
+ComputePools::~ComputePools() {
+    free();
+}
+
+bool ComputePools::create(int threads, int batchThreads, const PoolLayout &layout) {
+    ggml_threadpool_params params      = makeParams(threads, layout);
+    ggml_threadpool_params batchParams = makeParams(batchThreads, layout);
+
+    ggml_threadpool *newBatch  = nullptr;
+    ggml_threadpool *newDecode = nullptr;
+
+    if (!ggml_threadpool_params_match(&params, &batchParams)) {
+        newBatch = ggml_threadpool_new(&batchParams);
+        if (!newBatch) {
+            return false;
+        }
+        // Prompt processing runs first, the decode pool is woken by its first graph.
+        params.paused = true;
+    }
+
+    newDecode = ggml_threadpool_new(&params);
+    if (!newDecode) {
+        if (newBatch) {
+            ggml_threadpool_free(newBatch);
+        }
+        return false;
+    }
+
+    free();
+    decode = newDecode;
+    batch  = newBatch;
+    return true;
+}
+
+void ComputePools::attach(llama_context *context) const {
+    if (context && decode) {
+        llama_attach_threadpool(context, decode, batch);
+    }
+}
+
+void ComputePools::free() {
+    if (decode) {
+        ggml_threadpool_free(decode);
+        decode = nullptr;
+    }
+    if (batch) {
+        ggml_threadpool_free(batch);
+        batch = nullptr;
+    }
+}
+
+void ComputePools::pause() {
+    if (decode) {
+        ggml_threadpool_pause(decode);
+    }
+    if (batch) {
+        ggml_threadpool_pause(batch);
+    }
+}
+
+bool ComputePools::initNuma(int strategy) {
+    static int applied = -1;
+
+    if (applied < 0) {
+        applied = std::clamp(strategy, int(GGML_NUMA_STRATEGY_DISABLED), int(GGML_NUMA_STRATEGY_NUMACTL));
+        llama_numa_init(static_cast<ggml_numa_strategy>(applied));
+    }
+    return applied == strategy;
+}
+
+ggml_threadpool_params ComputePools::makeParams(int threads, const PoolLayout &layout) {
+    ggml_threadpool_params params = ggml_threadpool_params_default(std::clamp(threads, 1, GGML_MAX_N_THREADS));
+    params.poll       = std::clamp(layout.poll, 0, 100);
+    params.strict_cpu = layout.strictCpu;
+
+    for (int core : layout.cores) {
+        if (core >= 0 && core < GGML_MAX_N_THREADS) {
+            params.cpumask[core] = true;
+        }
+    }
+    return params;
+}
@@ -0,0 +1,43 @@
+#ifndef COMPUTEPOOLS_H
+#define COMPUTEPOOLS_H
+
+#include <vector>
+#include "llama.h"
+#include "ggml-cpu.h"
+
+// Where and how the compute threads run.
+struct PoolLayout {
+    std::vector<int> cores;             // empty leaves placement to the OS
+    int poll            = 50;           // 0 sleeps as soon as a graph is done, 100 spins for the next one
+    bool strictCpu      = false;        // one core per thread instead of the whole set
+};
+
+// Persistent ggml threadpools attached to llama contexts, instead of ggml
+// spawning fresh unpinned threads for every graph. Decode and prompt
+// processing get separate pools when their thread counts differ.
+class ComputePools
+{
+public:
+    ~ComputePools();
+
+    // Replaces any existing pools. Contexts must be attached again afterwards.
+    bool create(int threads, int batchThreads, const PoolLayout &layout);
+    void attach(llama_context *context) const;
+    void free();
+
+    // Lets polling threads go to sleep while nothing is being generated,
+    // the next graph resumes them.
+    void pause();
+
+    // NUMA placement can only be chosen once per process, later calls
+    // return false if they ask for a different strategy.
+    static bool initNuma(int strategy);
+
+private:
+    ggml_threadpool *decode     = nullptr;
+    ggml_threadpool *batch      = nullptr;
+
+    static ggml_threadpool_params makeParams(int threads, const PoolLayout &layout);
+};
+
+#endif // COMPUTEPOOLS_H
@@ -0,0 +1,78 @@
+#include "cpuaffinity.h"
+#include <QStringList>
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+int CpuAffinity::cpuCount() {
+#ifdef __linux__
+    // Configured rather than online or allowed CPUs, so ids stay valid after
+    // this process has pinned itself to a subset.
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    if (count > 0) {
+        return std::min<long>(count, CPU_SETSIZE);
+    }
+#endif
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<int> CpuAffinity::parse(const QString &list) {
+    const int count = cpuCount();
+    std::vector<int> cores;
+
+    for (const QString &part : list.split(',', Qt::SkipEmptyParts)) {
+        const QStringList range = part.trimmed().split('-');
+        bool okFirst = false, okLast = true;
+        int first = range.at(0).toInt(&okFirst);
+        int last  = range.size() > 1 ? range.at(1).toInt(&okLast) : first;
+
+        if (!okFirst || !okLast || range.size() > 2 || first > last) {
+            continue;
+        }
+        for (int core = std::max(0, first); core <= std::min(last, count - 1); ++core) {
+            cores.push_back(core);
+        }
+    }
+
+    std::sort(cores.begin(), cores.end());
+    cores.erase(std::unique(cores.begin(), cores.end()), cores.end());
+    return cores;
+}
+
+std::vector<int> CpuAffinity::resolve(const QString &preferred, const QString &reserved) {
+    std::vector<int> cores = parse(preferred);
+    if (!cores.empty()) {
+        return cores;
+    }
+
+    const std::vector<int> taken = parse(reserved);
+    for (int core = 0; core < cpuCount(); ++core) {
+        if (!std::binary_search(taken.begin(), taken.end(), core)) {
+            cores.push_back(core);
+        }
+    }
+    return cores.empty() ? parse(QString("0-%1").arg(cpuCount() - 1)) : cores;
+}
+
+bool CpuAffinity::pinCurrentThread(const std::vector<int> &cores) {
+#ifdef __linux__
+    if (cores.empty()) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        CPU_SET(core, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    Q_UNUSED(cores);
+    return false;
+#endif
+}
@@ -0,0 +1,24 @@
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+#include <QString>
+#include <vector>
+
+// Core lists in the usual "0-7,16,18-19" form, and pinning threads to them.
+// Kept free of ggml so both the llama and the whisper side can use it.
+class CpuAffinity
+{
+public:
+    static int cpuCount();
+
+    // Invalid or out of range entries are skipped, the result is sorted and unique.
+    static std::vector<int> parse(const QString &list);
+
+    // `preferred` if set, otherwise every CPU not claimed by `reserved`, otherwise all of them.
+    static std::vector<int> resolve(const QString &preferred, const QString &reserved);
+
+    // Threads created afterwards by this thread inherit the mask.
+    static bool pinCurrentThread(const std::vector<int> &cores);
+};
+
+#endif // CPUAFFINITY_H
@@ -0,0 +1,168 @@
+#include "fusedsampler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr int BLOCK = 16;
+
+// True if any of the BLOCK floats at `p` is greater than `threshold`.
+inline bool anyAbove(const float *p, float threshold) {
+#if defined(__AVX512F__)
+    return _mm512_cmp_ps_mask(_mm512_loadu_ps(p), _mm512_set1_ps(threshold), _CMP_GT_OQ) != 0;
+#elif defined(__AVX__)
+    const __m256 t = _mm256_set1_ps(threshold);
+    const __m256 gt = _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(p),     t, _CMP_GT_OQ),
+                                   _mm256_cmp_ps(_mm256_loadu_ps(p + 8), t, _CMP_GT_OQ));
+    return _mm256_movemask_ps(gt) != 0;
+#elif defined(__SSE__)
+    const __m128 t = _mm_set1_ps(threshold);
+    __m128 gt = _mm_cmpgt_ps(_mm_loadu_ps(p), t);
+    gt = _mm_or_ps(gt, _mm_cmpgt_ps(_mm_loadu_ps(p + 4),  t));
+    gt = _mm_or_ps(gt, _mm_cmpgt_ps(_mm_loadu_ps(p + 8),  t));
+    gt = _mm_or_ps(gt, _mm_cmpgt_ps(_mm_loadu_ps(p + 12), t));
+    return _mm_movemask_ps(gt) != 0;
+#else
+    bool any = false;
+    for (int i = 0; i < BLOCK; ++i) {
+        any |= p[i] > threshold;
+    }
+    return any;
+#endif
+}
+
+inline bool byLogit(const llama_token_data &a, const llama_token_data &b) {
+    return a.logit > b.logit;
+}
+
+} // namespace
+
+FusedSampler::FusedSampler(const SamplerParams &params) {
+    setParams(params);
+}
+
+void FusedSampler::setParams(const SamplerParams &params) {
+    current = params;
+    rng.seed(params.seed);
+
+    const int k = params.topK > 0 ? params.topK : 1024;
+    candidates.reserve(2 * k + BLOCK);
+}
+
+llama_token FusedSampler::sample(llama_context *ctx, int idx) {
+    const llama_vocab *vocab = llama_model_get_vocab(llama_get_model(ctx));
+    return sample(llama_get_logits_ith(ctx, idx), llama_vocab_n_tokens(vocab));
+}
+
+llama_token FusedSampler::sample(const float *logits, int n_vocab) {
+    if (current.temperature <= 0.0f) {
+        selectTopK(logits, n_vocab, 1);
+        return candidates.front().id;
+    }
+
+    const int k = current.topK > 0 ? std::min(current.topK, n_vocab) : n_vocab;
+    selectTopK(logits, n_vocab, k);
+    return draw();
+}
+
+void FusedSampler::selectTopK(const float *logits, int n_vocab, int k) {
+    candidates.clear();
+
+    if (k >= n_vocab) {
+        candidates.resize(n_vocab);
+        for (int i = 0; i < n_vocab; ++i) {
+            candidates[i] = {i, logits[i], 0.0f};
+        }
+        return;
+    }
+
+    // Collect anything beating the k-th best seen so far. Once the buffer holds
+    // 2k, cut it back to k, which raises the bar for the rest of the vocab, so
+    // most blocks are rejected by a single vector compare.
+    const size_t limit = 2 * size_t(k);
+    float threshold = -std::numeric_limits<float>::infinity();
+
+    auto consider = [&](int i) {
+        if (logits[i] > threshold) {
+            candidates.push_back({i, logits[i], 0.0f});
+        }
+    };
+
+    int i = 0;
+    for (; i + BLOCK <= n_vocab; i += BLOCK) {
+        if (!anyAbove(logits + i, threshold)) {
+            continue;
+        }
+        for (int j = i; j < i + BLOCK; ++j) {
+            consider(j);
+        }
+        if (candidates.size() >= limit) {
+            std::nth_element(candidates.begin(), candidates.begin() + k - 1, candidates.end(), byLogit);
+            candidates.resize(k);
+            threshold = candidates[k - 1].logit;
+        }
+    }
+    for (; i < n_vocab; ++i) {
+        consider(i);
+    }
+
+    if (candidates.size() > size_t(k)) {
+        std::nth_element(candidates.begin(), candidates.begin() + k - 1, candidates.end(), byLogit);
+        candidates.resize(k);
+    }
+    if (k == 1) {
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(), byLogit);
+}
+
+llama_token FusedSampler::draw() {
+    // Survivors are sorted unless the whole vocab was kept, which only the
+    // top-p cut needs.
+    if (current.topP < 1.0f && candidates.size() > 1 &&
+        !std::is_sorted(candidates.begin(), candidates.end(), byLogit)) {
+        std::sort(candidates.begin(), candidates.end(), byLogit);
+    }
+
+    float maxLogit = candidates.front().logit;
+    for (const llama_token_data &c : candidates) {
+        maxLogit = std::max(maxLogit, c.logit);
+    }
+
+    const float invTemp = 1.0f / current.temperature;
+    float sum = 0.0f;
+    for (llama_token_data &c : candidates) {
+        c.p = std::exp((c.logit - maxLogit) * invTemp);
+        sum += c.p;
+    }
+
+    // Keep the smallest prefix reaching top-p of the mass, always at least one.
+    size_t kept = candidates.size();
+    float keptSum = sum;
+    if (current.topP < 1.0f) {
+        const float target = current.topP * sum;
+        float cumulative = 0.0f;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            cumulative += candidates[i].p;
+            if (cumulative >= target) {
+                kept    = i + 1;
+                keptSum = cumulative;
+                break;
+            }
+        }
+    }
+
+    float r = std::uniform_real_distribution<float>(0.0f, keptSum)(rng);
+    for (size_t i = 0; i < kept; ++i) {
+        r -= candidates[i].p;
+        if (r <= 0.0f) {
+            return candidates[i].id;
+        }
+    }
+    return candidates[kept - 1].id;
+}
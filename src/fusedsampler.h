@@ -0,0 +1,42 @@
+#ifndef FUSEDSAMPLER_H
+#define FUSEDSAMPLER_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "llama.h"
+
+struct SamplerParams {
+    float temperature   = 0.8f;         // 0 or less samples greedily
+    int topK            = 40;           // 0 or less keeps the whole vocab
+    float topP          = 0.95f;
+    uint32_t seed       = 0;
+};
+
+// Temperature, top-k, top-p and the final draw in one sampler. Top-k is a
+// SIMD scan that only looks closer at blocks of logits beating the current
+// k-th best, the softmax and top-p cut only run over the k survivors. Buffers
+// are kept between tokens and parameters are changed in place, so nothing is
+// allocated per token once warm.
+class FusedSampler
+{
+public:
+    explicit FusedSampler(const SamplerParams &params = SamplerParams());
+
+    // Also restarts the random sequence from the seed.
+    void setParams(const SamplerParams &params);
+    const SamplerParams &params() const { return current; }
+
+    llama_token sample(llama_context *ctx, int idx);
+    llama_token sample(const float *logits, int n_vocab);
+
+private:
+    SamplerParams current;
+    std::mt19937 rng;
+    std::vector<llama_token_data> candidates;
+
+    void selectTopK(const float *logits, int n_vocab, int k);
+    llama_token draw();
+};
+
+#endif // FUSEDSAMPLER_H
@@ -1,241 +1,1379 @@
 #include "llamaworker.h"
+#include "sessionfile.h"
+#include "cpuaffinity.h"
+#include "memoryestimate.h"
+#include "trace.h"
 #include <QString>
+#include <QFile>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
-LlamaWorker::LlamaWorker() : ctx(nullptr), model(nullptr), sampler(nullptr) {}
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+LlamaWorker::LlamaWorker() 
+    : ctx(nullptr), model(nullptr), batch({}), maxContext(0)
+    , draftModel(nullptr), draftCtx(nullptr), draftSampler(nullptr), draftLength(0), loadPercent(-1)
+    , useCounter(0), roundRobin(0), scheduler(new QTimer(this)), metrics(nullptr), energy(nullptr), stopRequested(false), cancelPending(false) 
+{
+    // Runs one batched decode per event loop iteration while any session is
+    // active, so new requests are picked up between steps.
+    scheduler->setInterval(0);
+    connect(scheduler, &QTimer::timeout, this, &LlamaWorker::step);
+    kvSampleTimer.start();
+    
+    llama_backend_init();
+}
 
 LlamaWorker::~LlamaWorker() {
     cleanup();
+    registry.clear();
+    llama_backend_free();
 }
 
 void LlamaWorker::loadModel(const QString &modelPath, const ContextSettings &settings) {
+    TraceSpan span("llama.loadModel");
     cleanup();
      
-    llama_backend_init();
-     
+    QElapsedTimer timer;
+    timer.start();
+    
+    if (settings.prefetch) {
+        prefetchModelFile(modelPath);
+    }
+    
     llama_model_params model_params = llama_model_default_params();
+    model_params.use_mmap   = settings.useMmap;
+    model_params.use_mlock  = settings.useMlock;
+    
+    // Also the only point a reload or shutdown can interrupt a slow load.
+    loadPercent = -1;
+    model_params.progress_callback = [](float progress, void *data) {
+        auto *worker = static_cast<LlamaWorker *>(data);
+        int percent = progress * 100.0f;
+        if (percent != worker->loadPercent) {
+            worker->loadPercent = percent;
+            emit worker->loadProgress(percent);
+        }
+        return !worker->stopRequested.load();
+    };
+    model_params.progress_callback_user_data = this;
      
-    model = llama_model_load_from_file(modelPath.toStdString().c_str(), model_params);
+    // Has to happen before any weights are mapped.
+    if (!ComputePools::initNuma(settings.numaStrategy)) {
+        emit warningOccurred("NUMA strategy changes take effect after restarting Lunaria");
+    }
+    
+    registry.setBudget(quint64(std::max(0, settings.residentBudgetMb)) << 20);
+    responseCache.configure(qint64(std::max(0, settings.responseCacheMb)) << 20, settings.responseCachePath,
+                            qint64(std::max(0, settings.responseCacheDiskMb)) << 20);
+    
+    bool wasResident = false;
+    model = registry.acquire(modelPath, model_params, &wasResident);
     
     if (!model) {
-        emit errorOccurred("Can't load model");
+        emit errorOccurred(stopRequested ? "Model loading cancelled" : "Can't load model");
+        emit residentModelsChanged(registry.residentModels());
+        stopRequested = false;
         return;
     }
      
+    const int n_seq_max = std::max(1, settings.maxSessions);
+    
+    // An elastic context starts at one batch or 1024 cells, whichever is larger,
+    // since llama.cpp caps the batch at n_ctx and our batch buffer can't grow.
+    maxContext = settings.contextSize;
+    const int n_ctx = settings.elasticContext ?
+        std::min(maxContext, std::max(ELASTIC_CONTEXT_START, settings.batchSize)) : maxContext;
+    
     llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx        = settings.contextSize;
+    ctx_params.n_ctx        = n_ctx;
     ctx_params.n_threads    = settings.threadCount;
+    ctx_params.n_threads_batch = settings.batchThreadCount;
     ctx_params.n_batch      = settings.batchSize;
+    ctx_params.n_seq_max    = n_seq_max;
+    ctx_params.kv_unified   = true;     // sessions share one KV pool instead of n_ctx / n_seq_max each
+    ctx_params.flash_attn_type = static_cast<llama_flash_attn_type>(settings.flashAttention);
+    ctx_params.type_k       = static_cast<ggml_type>(settings.kvCacheType);
+    ctx_params.type_v       = MemoryEstimate::valueType(settings.kvCacheType, settings.flashAttention);
      
-    ctx = llama_init_from_model(model, ctx_params);
+    poolLayout = makePoolLayout(settings);
+    if (!pools.create(settings.threadCount, settings.batchThreadCount, poolLayout)) {
+        emit warningOccurred("Can't create compute threadpools, using unpinned threads");
+    }
+    
+    ctxParams = ctx_params;
+    ctx = initContext(model, ctx_params);
     
     if (!ctx) {
-        emit errorOccurred("Failed to initialize context");
+        emit errorOccurred("Failed to initialize context, try a smaller context or a quantized KV cache");
         return;
     }
-      
-    llama_sampler_chain_params sampler_params = llama_sampler_chain_default_params();
-    sampler = llama_sampler_chain_init(sampler_params);
-    llama_sampler_chain_add(sampler, llama_sampler_init_greedy());
     
+    // Draft models share the vocab, one table serves both.
+    pieces.build(llama_model_get_vocab(model));
+    
+    modelFingerprint = SessionFile::fingerprint(modelPath);
+    contextKey       = SessionFile::makeContextKey(settings);
+    
+    for (llama_seq_id seq = n_seq_max - 1; seq >= 0; --seq) {
+        freeSeqs.push_back(seq);
+    }
+    
+    if (!settings.draftModelPath.isEmpty() && !loadDraftModel(settings)) {
+        freeDraftModel();
+    }
+    
+    batch = llama_batch_init(std::max<int>(llama_n_batch(ctx), draftLength + 1), 0, 1);
+    
+    const qint64 loadMs = timer.restart();
+    
+    // The first decode pays for lazy backend init and faulting in the weights,
+    // do it now rather than on the user's first prompt.
+    // A resident model's weights are already paged in, skip it to keep switching instant.
+    if (settings.warmup && !wasResident) {
+        warmupContext(ctx, model);
+        if (draftCtx) {
+            warmupContext(draftCtx, draftModel);
+        }
+    }
+    
+    emit loadTimings(loadMs, timer.elapsed());
+    emit residentModelsChanged(registry.residentModels());
     emit modelLoaded();
 }
 
-void LlamaWorker::updateSampler(const GenerationSettings &settings) {
-    if (sampler) {
-        llama_sampler_free(sampler);
+bool LlamaWorker::loadDraftModel(const ContextSettings &settings) {
+    llama_model_params model_params = llama_model_default_params();
+    model_params.use_mmap   = settings.useMmap;
+    model_params.use_mlock  = settings.useMlock;
+    
+    draftModel = registry.acquire(settings.draftModelPath, model_params);
+    
+    if (!draftModel) {
+        emit warningOccurred("Can't load draft model, speculative decoding disabled");
+        return false;
     }
+     
+    // Drafted token ids are fed to the main model as-is, so both vocabs must line up.
+    const llama_vocab *vocab       = llama_model_get_vocab(model);
+    const llama_vocab *draft_vocab = llama_model_get_vocab(draftModel);
     
-    llama_sampler_chain_params sampler_params = llama_sampler_chain_default_params();
-    sampler = llama_sampler_chain_init(sampler_params);
+    if (std::abs(llama_vocab_n_tokens(vocab) - llama_vocab_n_tokens(draft_vocab)) > 128 ||
+        llama_vocab_bos(vocab) != llama_vocab_bos(draft_vocab) ||
+        llama_vocab_eos(vocab) != llama_vocab_eos(draft_vocab) ||
+        llama_vocab_get_add_bos(vocab) != llama_vocab_get_add_bos(draft_vocab)) {
+        emit warningOccurred("Draft model vocab doesn't match the main model, speculative decoding disabled");
+        return false;
+    }
      
-    if (settings.temperature > 0.0) {
-        llama_sampler_chain_add(sampler, 
-            llama_sampler_init_temp(settings.temperature));
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_threads    = settings.threadCount;
+    ctx_params.n_threads_batch = settings.batchThreadCount;
+    ctx_params.n_batch      = settings.batchSize;
+    ctx_params.flash_attn_type = static_cast<llama_flash_attn_type>(settings.flashAttention);
+    ctx_params.type_k       = static_cast<ggml_type>(settings.kvCacheType);
+    ctx_params.type_v       = MemoryEstimate::valueType(settings.kvCacheType, settings.flashAttention);
+    
+    // Grows along with the main context.
+    ctx_params.n_ctx        = llama_n_ctx(ctx);
+    
+    draftCtxParams = ctx_params;
+    draftCtx = initContext(draftModel, ctx_params);
+    
+    if (!draftCtx) {
+        emit warningOccurred("Failed to initialize draft context, speculative decoding disabled");
+        return false;
+    }
+     
+    llama_sampler_chain_params sampler_params = llama_sampler_chain_default_params();
+    draftSampler = llama_sampler_chain_init(sampler_params);
+    llama_sampler_chain_add(draftSampler, llama_sampler_init_greedy());
+    
+    draftLength = std::max(1, settings.draftTokens);
+    return true;
+}
+
+void LlamaWorker::prefetchModelFile(const QString &path) {
+#ifdef __linux__
+    // Starts asynchronous readahead of the whole file into the page cache, so
+    // the loader's page faults or reads hit memory instead of waiting on disk.
+    int fd = ::open(path.toLocal8Bit().constData(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+llama_context *LlamaWorker::initContext(llama_model *model, const llama_context_params &params) {
+    llama_context *context = llama_init_from_model(model, params);
+    if (!context) {
+        return nullptr;
+    }
+    
+    // Lets a stop or cancel request interrupt a long prefill chunk mid-graph.
+    llama_set_abort_callback(context, [](void *data) {
+        auto *worker = static_cast<LlamaWorker *>(data);
+        return worker->stopRequested.load() || worker->cancelPending.load();
+    }, this);
+    
+    // Draft and main model never decode at the same time, they share the pools.
+    pools.attach(context);
+    return context;
+}
+
+PoolLayout LlamaWorker::makePoolLayout(const ContextSettings &settings) {
+    PoolLayout layout;
+    layout.poll      = settings.pollLevel;
+    layout.strictCpu = settings.strictCpu;
+    
+    // With nothing configured ggml's threads go wherever the OS puts them.
+    if (!settings.computeCores.isEmpty() || !settings.auxCores.isEmpty() || settings.strictCpu) {
+        layout.cores = CpuAffinity::resolve(settings.computeCores, settings.auxCores);
+    }
+    return layout;
+}
+
+void LlamaWorker::warmupContext(llama_context *context, const llama_model *model) {
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    
+    std::vector<llama_token> tokens;
+    if (llama_vocab_bos(vocab) != LLAMA_TOKEN_NULL) {
+        tokens.push_back(llama_vocab_bos(vocab));
+    }
+    if (llama_vocab_eos(vocab) != LLAMA_TOKEN_NULL) {
+        tokens.push_back(llama_vocab_eos(vocab));
+    }
+    if (tokens.empty()) {
+        tokens.push_back(0);
+    }
+    
+    llama_set_warmup(context, true);
+    llama_decode(context, llama_batch_get_one(tokens.data(), tokens.size()));
+    llama_set_warmup(context, false);
+    
+    llama_memory_clear(llama_get_memory(context), true);
+    llama_synchronize(context);
+    llama_perf_context_reset(context);
+}
+
+void LlamaWorker::freeDraftModel() {
+    draftCachedTokens.clear();
+    draftLength = 0;
+    if (draftSampler) {
+        llama_sampler_free(draftSampler);
+        draftSampler = nullptr;
+    }
+    if (draftCtx) {
+        llama_free(draftCtx);
+        draftCtx = nullptr;
+    }
+    if (draftModel) {
+        registry.release(draftModel);
+        draftModel = nullptr;
+    }
+}
+
+void LlamaWorker::updateSampler(FusedSampler &sampler, const GenerationSettings &settings) {
+    // Reconfigured in place, its buffers stay allocated across requests.
+    SamplerParams params;
+    params.temperature  = settings.temperature;
+    params.topK         = settings.topK;
+    params.topP         = settings.topP;
+    params.seed         = 0;
+    sampler.setParams(params);
+}
+
+bool LlamaWorker::applyChatTemplate(const char *tmpl, const std::vector<llama_chat_message> &messages, size_t count, bool add_assistant, std::string &out) {
+    TraceSpan span("llama.applyTemplate");
+    out.resize(std::max<size_t>(out.capacity(), 4096));
+    int n = llama_chat_apply_template(tmpl, messages.data(), count, add_assistant, out.data(), out.size());
+    if (n > (int) out.size()) {
+        out.resize(n);
+        n = llama_chat_apply_template(tmpl, messages.data(), count, add_assistant, out.data(), out.size());
+    }
+    if (n < 0) {
+        out.clear();
+        return false;
+    }
+    out.resize(n);
+    return true;
+}
+
+// Each message's piece of the rendered template is cached on the history with
+// its tokens, so only the messages added since the last turn are tokenized.
+bool LlamaWorker::buildPrompt(const ChatHistory &history, std::vector<llama_token> &tokens, int &keepTokens) {
+    TraceSpan span("llama.buildPrompt");
+    const char *tmpl = model ? llama_model_chat_template(model, nullptr) : nullptr;
+    if (!tmpl || history.empty()) {
+        return false;
+    }
+    
+    // Points straight into the history's UTF-8 arena.
+    std::vector<llama_chat_message> messages(history.size());
+    for (size_t i = 0; i < history.size(); ++i) {
+        messages[i] = {history.role(i), history.content(i)};
+    }
+    
+    std::string prefix;
+    std::string rendered;
+    bool segmented    = true;
+    bool pinnedPrefix = true;
+    tokens.clear();
+    keepTokens = 0;
+    
+    for (size_t i = 0; i < history.size(); ++i) {
+        ChatHistory::Segment &segment = history.segment(i);
         
-        if (settings.topK > 0) {
-            llama_sampler_chain_add(sampler, 
-                llama_sampler_init_top_k(settings.topK));
+        if (segment.key != modelFingerprint) {
+            // Templates that render earlier turns differently once more follow
+            // can't be split into segments, they get the whole prompt tokenized.
+            segmented = applyChatTemplate(tmpl, messages, i + 1, false, rendered) &&
+                        rendered.compare(0, prefix.size(), prefix) == 0;
+            if (!segmented) {
+                break;
+            }
+            segment.text   = rendered.substr(prefix.size());
+            segment.tokens = tokenize(segment.text, i == 0);
+            segment.key    = modelFingerprint;
         }
         
-        if (settings.topP < 1.0) {
-            llama_sampler_chain_add(sampler, 
-                llama_sampler_init_top_p(settings.topP, 1));
-        }
+        prefix += segment.text;
+        tokens.insert(tokens.end(), segment.tokens.begin(), segment.tokens.end());
         
-        llama_sampler_chain_add(sampler, llama_sampler_init_dist(0));
-    } else {
-        llama_sampler_chain_add(sampler, llama_sampler_init_greedy());
+        pinnedPrefix = pinnedPrefix && history.pinned(i);
+        if (pinnedPrefix) {
+            keepTokens = tokens.size();
+        }
+    }
+    
+    // The generation prompt is the only part rendered and tokenized every turn.
+    if (segmented && applyChatTemplate(tmpl, messages, history.size(), true, rendered) &&
+        rendered.compare(0, prefix.size(), prefix) == 0) {
+        std::vector<llama_token> tail = tokenize(std::string_view(rendered).substr(prefix.size()), false);
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        return !tokens.empty();
     }
+    
+    if (!applyChatTemplate(tmpl, messages, history.size(), true, rendered)) {
+        return false;
+    }
+    tokens     = tokenize(rendered, true);
+    keepTokens = countPinnedTokens(tmpl, messages, history, tokens);
+    return !tokens.empty();
 }
 
-QString LlamaWorker::applyChatTemplate(const std::vector<ChatMessage> &messages, bool add_assistant) {
-    if (!model) {
-        return QString();
+void LlamaWorker::generateResponseWithMessages(int sessionId, const ChatHistory &history, const GenerationSettings &settings) {
+    if (!ctx || !model) {
+        emit sessionError(sessionId, "Model not loaded");
+        return;
+    }
+    
+    Session &session = sessions[sessionId];
+    session.id = sessionId;
+    
+    // A new message preempts the answer still being generated for this conversation.
+    if (session.state != Session::State::Idle) {
+        cancelSession(session);
     }
     
-    const char *tmpl = llama_model_chat_template(model, nullptr);
-    if (!tmpl) {
-        return QString();
+    if (!assignSequence(session)) {
+        emit sessionError(sessionId, "Too many concurrent sessions");
+        return;
     }
+    
+    session.settings = settings;
+    session.lastUsed = ++useCounter;
+    updateSampler(session.sampler, settings);
      
-    std::vector<llama_chat_message> llama_messages;
-    for (const auto &msg : messages) {
-        llama_chat_message llama_msg;
-        llama_msg.role = strdup(msg.role.toStdString().c_str());
-        llama_msg.content = strdup(msg.content.toStdString().c_str());
-        llama_messages.push_back(llama_msg);
+    std::vector<llama_token> tokens;
+    
+    if (!buildPrompt(history, tokens, session.keepTokens)) {
+        emit sessionError(sessionId, "Failed to apply chat template");
+        return;
     }
      
-    int required_size = llama_chat_apply_template(
-        tmpl, 
-        llama_messages.data(), 
-        llama_messages.size(), 
-        add_assistant, 
-        nullptr, 
-        0
-    );
+    restoreShiftedPrompt(session, tokens);
     
-    if (required_size < 0) {
- 
-        for (auto &msg : llama_messages) {
-            free(const_cast<char*>(msg.role));
-            free(const_cast<char*>(msg.content));
+    if (!settings.contextShift && (int) tokens.size() > maxContext) {
+        emit sessionError(sessionId, "Context size exceeded");
+        return;
+    }
+    
+    session.stats     = GenerationStats();
+    session.timer.start();
+    session.energyStart = energy ? energy->microjoules() : 0;
+    
+    // A cached answer is replayed without touching the sequence's KV state.
+    session.cacheKey = responseCacheKey(session, tokens);
+    if (!session.cacheKey.isEmpty()) {
+        ResponseCache::Entry entry;
+        const bool hit = responseCache.lookup(session.cacheKey, entry);
+        emit responseCacheStats(responseCache.stats());
+        if (hit) {
+            replayResponse(session, entry, tokens.size());
+            return;
         }
-        return QString();
+    }
+    
+    session.promptPos = reuseCachedPrefix(session, tokens);
+    session.prompt    = std::move(tokens);
+    // Keeps its capacity from the last turn, most answers fit without growing it.
+    // Bounded by the context, max_tokens comes straight from API and batch requests.
+    session.response.resize(0);
+    session.response.reserve(std::min<qint64>(settings.maxTokens, llama_n_ctx(ctx)) * 4);
+    session.generated = 0;
+    session.state     = Session::State::Prefill;
+    
+    session.stats.promptTokens = session.prompt.size();
+    session.stats.cachedTokens = session.promptPos;
+    session.lookup.setNgramSize(settings.lookupNgram);
+    
+    // A pending stop is left for processCancellations(), clearing it here
+    // would lose a stop queued behind this request.
+    scheduler->start();
+}
+
+void LlamaWorker::step() {
+    std::vector<Session *> active = activeSessions();
+    
+    if (active.empty()) {
+        scheduler->stop();
+        pools.pause();
+        return;
     }
      
-    std::vector<char> formatted(required_size);
-    int actual_size = llama_chat_apply_template(
-        tmpl,
-        llama_messages.data(),
-        llama_messages.size(),
-        add_assistant,
-        formatted.data(),
-        formatted.size()
-    );
+    if (stopRequested || cancelPending) {
+        processCancellations();
+        return;
+    }
+    
+    TraceSpan span("llama.step");
+    
+    if (metrics && metrics->enabled() && kvSampleTimer.hasExpired(KV_SAMPLE_MS)) {
+        metrics->record(MetricsChannel::KvCells, usedCells(), llama_n_ctx(ctx));
+        kvSampleTimer.restart();
+    }
+    
+    // Grow before building the batch, so no queued token refers to the old context.
+    int n_needed = 0;
+    for (Session *session : active) {
+        if (session->state == Session::State::Decode) {
+            const int n_lookup = session->settings.promptLookup ? session->settings.lookupTokens : 0;
+            n_needed += 1 + (active.size() == 1 ? std::max(draftLength, n_lookup) : 0);
+        } else {
+            n_needed += session->prompt.size() - session->promptPos;
+        }
+    }
+    if (growContext(std::min<int>(n_needed, llama_n_batch(ctx)))) {
+        active = activeSessions();
+        if (active.empty()) {
+            return;
+        }
+    }
+     
+    // Speculation needs the whole batch for one sequence, so it only kicks in
+    // while a single conversation is decoding.
+    if (active.size() == 1 && active[0]->state == Session::State::Decode &&
+        (draftCtx || active[0]->settings.promptLookup)) {
+        speculativeStep(*active[0]);
+        return;
+    }
+    
+    const int n_batch = llama_n_batch(ctx);
+    std::vector<Session *> scheduled;
+    batch.n_tokens = 0;
+     
+    // Decoding sessions always get their next token in, they are latency bound.
+    for (Session *session : active) {
+        if (session->state != Session::State::Decode) {
+            continue;
+        }
+        if (!reserveCells(*session, 1)) {
+            finishSession(*session, "Context limit reached");
+            continue;
+        }
+        session->batchIndex = batch.n_tokens;
+        batchAdd(batch, session->pending, session->cachedTokens.size(), session->seq, true);
+        scheduled.push_back(session);
+    }
      
-    for (auto &msg : llama_messages) {
-        free(const_cast<char*>(msg.role));
-        free(const_cast<char*>(msg.content));
+    // The rest of the batch goes to prompt processing, in priority order.
+    int budget = n_batch - batch.n_tokens;
+    for (Session *session : active) {
+        if (session->state != Session::State::Prefill || budget <= 0) {
+            continue;
+        }
+        
+        int n_eval = std::min<int>(budget, session->prompt.size() - session->promptPos);
+        if (!reserveCells(*session, n_eval)) {
+            finishSession(*session, "Context size exceeded");
+            continue;
+        }
+        
+        const llama_pos n_past = session->cachedTokens.size();
+        for (int i = 0; i < n_eval; ++i) {
+            bool last = session->promptPos + i + 1 == session->prompt.size();
+            batchAdd(batch, session->prompt[session->promptPos + i], n_past + i, session->seq, last);
+        }
+        session->batchChunk = n_eval;
+        session->batchIndex = batch.n_tokens - 1;
+        budget -= n_eval;
+        scheduled.push_back(session);
     }
     
-    if (actual_size < 0) {
-        return QString();
+    if (batch.n_tokens == 0) {
+        return;
     }
     
-    return QString::fromStdString(std::string(formatted.begin(), formatted.begin() + actual_size));
+    const bool prefill = std::any_of(scheduled.begin(), scheduled.end(), [](const Session *session) {
+        return session->state == Session::State::Prefill;
+    });
+    
+    int ret;
+    {
+        TraceSpan decodeSpan(prefill ? "llama.prefill" : "llama.decode");
+        ret = llama_decode(ctx, batch);
+    }
+    if (ret == 2) {
+        rollbackBatch(scheduled);
+        return;
+    }
+    if (ret != 0) {
+        for (Session *session : scheduled) {
+            resetSessionCache(*session);
+            finishSession(*session, session->state == Session::State::Prefill ? "Failed to evaluate prompt" : "Failed to decode token");
+        }
+        return;
+    }
+     
+    for (Session *session : scheduled) {
+        if (session->state == Session::State::Decode) {
+            session->cachedTokens.push_back(session->pending);
+            acceptToken(*session, session->sampler.sample(ctx, session->batchIndex));
+            continue;
+        }
+        
+        auto chunk = session->prompt.begin() + session->promptPos;
+        session->cachedTokens.insert(session->cachedTokens.end(), chunk, chunk + session->batchChunk);
+        session->promptPos += session->batchChunk;
+        
+        const int total = session->prompt.size();
+        const int processed = session->promptPos - session->stats.cachedTokens;
+        double seconds = session->timer.nsecsElapsed() / 1e9;
+        emit promptProgress(session->id, session->promptPos, total, seconds > 0.0 ? processed / seconds : 0.0);
+        
+        if ((int) session->promptPos == total) {
+            session->stats.prefillMs = session->timer.restart();
+            session->state = Session::State::Decode;
+            session->responseStart = session->cachedTokens.size();
+            acceptToken(*session, session->sampler.sample(ctx, session->batchIndex));
+            session->stats.firstTokenMs = session->stats.prefillMs + session->timer.elapsed();
+        }
+    }
 }
 
-void LlamaWorker::generateResponseWithMessages(const std::vector<ChatMessage> &messages, const GenerationSettings &settings) {
-    if (!ctx || !model) {
-        emit errorOccurred("Model not loaded");
+void LlamaWorker::speculativeStep(Session &session) {
+    TraceSpan span("llama.speculativeStep");
+    const int n_ctx = llama_n_ctx(ctx);
+    const llama_token id = session.pending;
+    batch.n_tokens = 0;
+    
+    int n_room = std::min(session.settings.maxTokens - session.generated, n_ctx - usedCells() - 1);
+    std::vector<llama_token> draft;
+     
+    // Copying from the prompt is free, only fall back to the draft model when nothing matches.
+    if (session.settings.promptLookup) {
+        session.lookup.sync(session.cachedTokens);
+        draft = session.lookup.propose(id, std::min(session.settings.lookupTokens, n_room));
+    }
+    if (draft.empty()) {
+        draft = draftTokens(session, std::min(draftLength, n_room));
+    }
+    draft.resize(std::min<size_t>(draft.size(), llama_n_batch(ctx) - 1));   // room for `id` in the batch
+     
+    if (!reserveCells(session, 1 + draft.size())) {
+        draft.clear();
+        if (!reserveCells(session, 1)) {
+            finishSession(session, "Context limit reached");
+            return;
+        }
+    }
+     
+    // Verify the last sampled token and all drafted ones in a single decode.
+    const int n_past = session.cachedTokens.size();
+    batchAdd(batch, id, n_past, session.seq, true);
+    for (size_t i = 0; i < draft.size(); ++i) {
+        batchAdd(batch, draft[i], n_past + 1 + i, session.seq, true);
+    }
+    
+    int ret;
+    {
+        TraceSpan decodeSpan("llama.decode");
+        ret = llama_decode(ctx, batch);
+    }
+    if (ret == 2) {
+        rollbackBatch({&session});
+        return;
+    }
+    if (ret != 0) {
+        resetSessionCache(session);
+        finishSession(session, "Failed to decode token");
         return;
     }
+    session.cachedTokens.push_back(id);
+    session.cachedTokens.insert(session.cachedTokens.end(), draft.begin(), draft.end());
+     
+    // Keep drafted tokens for as long as the main model samples the same ones.
+    size_t n_accepted = 0;
+    llama_token next = session.sampler.sample(ctx, 0);
     
-    updateSampler(settings);
+    while (n_accepted < draft.size() && next == draft[n_accepted]) {
+        n_accepted++;
+        
+        if (!acceptToken(session, next)) {
+            break;
+        }
+        next = session.sampler.sample(ctx, n_accepted);
+    }
+     
+    session.stats.draftedTokens  += draft.size();
+    session.stats.acceptedTokens += n_accepted;
+     
+    // Rejected drafts were decoded at positions the main sequence won't use.
+    if (n_accepted < draft.size()) {
+        int n_keep = n_past + 1 + n_accepted;
+        llama_memory_seq_rm(llama_get_memory(ctx), session.seq, n_keep, -1);
+        session.cachedTokens.resize(n_keep);
+    }
     
+    if (session.state == Session::State::Decode) {
+        acceptToken(session, next);
+    }
+}
+
+bool LlamaWorker::acceptToken(Session &session, llama_token id) {
     const llama_vocab *vocab = llama_model_get_vocab(model);
-     
-    QString formatted_prompt = applyChatTemplate(messages, true);
     
-    if (formatted_prompt.isEmpty()) {
-        emit errorOccurred("Failed to apply chat template");
+    if (llama_vocab_is_eog(vocab, id) || !appendPiece(session, id) ||
+        ++session.generated >= session.settings.maxTokens) {
+        finishSession(session);
+        return false;
+    }
+    
+    session.pending = id;
+    return true;
+}
+
+void LlamaWorker::finishSession(Session &session, const QString &error) {
+    const bool decoding = session.state == Session::State::Decode;
+    session.state = Session::State::Idle;
+    session.pending = -1;
+    session.prompt.clear();
+    session.prompt.shrink_to_fit();
+    
+    // What was generated before a mid-decode failure still belongs in the
+    // history, it just isn't cached.
+    if (!error.isEmpty()) {
+        if (decoding) {
+            emit responseGenerated(session.id, QString::fromUtf8(session.response));
+        }
+        emit sessionError(session.id, error);
         return;
     }
     
-    std::string prompt_str = formatted_prompt.toStdString();
-     
-    bool is_first = llama_memory_seq_pos_max(llama_get_memory(ctx), 0) == -1;
+    session.stats.generatedTokens = session.generated;
+    session.stats.decodeMs        = session.timer.elapsed();
+    if (energy) {
+        session.stats.energyJoules = (energy->microjoules() - session.energyStart) / 1e6;
+    }
+    
+    if (metrics && metrics->enabled()) {
+        const GenerationStats &stats = session.stats;
+        const int evaluated = stats.promptTokens - stats.cachedTokens;
+        metrics->record(MetricsChannel::DecodeTps,    stats.decodeMs > 0 ? stats.generatedTokens * 1000.0 / stats.decodeMs : 0.0);
+        metrics->record(MetricsChannel::FirstTokenMs, stats.firstTokenMs);
+        metrics->record(MetricsChannel::PrefillTps,   stats.prefillMs > 0 ? evaluated * 1000.0 / stats.prefillMs : 0.0);
+        metrics->record(MetricsChannel::KvCells,      usedCells(), llama_n_ctx(ctx));
+        if (stats.energyJoules > 0.0 && stats.generatedTokens > 0) {
+            metrics->record(MetricsChannel::JoulesPerToken, stats.energyJoules / stats.generatedTokens);
+        }
+    }
+    
+    if (!session.cacheKey.isEmpty()) {
+        responseCache.insert(session.cacheKey, {session.response, session.generated});
+        emit responseCacheStats(responseCache.stats());
+    }
+    
+    emit responseGenerated(session.id, QString::fromUtf8(session.response));
+    emit generationStats(session.id, session.stats);
+}
+
+// Sampling restarts from the same seed every request, so the answer depends
+// only on the model, the context layout, the settings and the prompt. With
+// temperature above 0 speculation changes how the sampler draws, those
+// requests are not cached.
+QByteArray LlamaWorker::responseCacheKey(const Session &session, const std::vector<llama_token> &tokens) const {
+    const GenerationSettings &settings = session.settings;
+    const bool speculative = draftModel || settings.promptLookup;
+    if (!responseCache.enabled() || modelFingerprint.isEmpty() || (settings.temperature > 0.0 && speculative)) {
+        return QByteArray();
+    }
+    
+    const QString params = QString("max=%1 temp=%2 top_p=%3 top_k=%4 shift=%5 keep=%6 draft=%7")
+        .arg(settings.maxTokens)
+        .arg(settings.temperature, 0, 'g', 17)
+        .arg(settings.topP, 0, 'g', 17)
+        .arg(settings.topK)
+        .arg(settings.contextShift)
+        .arg(session.keepTokens)
+        .arg(draftModel ? draftLength : 0);
+    
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(modelFingerprint.toUtf8());
+    hash.addData(contextKey.toUtf8());
+    hash.addData(params.toUtf8());
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(tokens.data()), tokens.size() * sizeof(llama_token)));
+    return hash.result();
+}
+
+// Streams a cached answer the way a generated one would have been.
+void LlamaWorker::replayResponse(Session &session, const ResponseCache::Entry &entry, int promptTokens) {
+    TraceSpan span("llama.replayResponse");
+    const QByteArray &text = entry.response;
+    for (qsizetype pos = 0; pos < text.size(); pos += REPLAY_CHUNK) {
+        if (stream.write(session.id, text.constData() + pos, std::min<qsizetype>(REPLAY_CHUNK, text.size() - pos))) {
+            emit streamReady();
+        }
+    }
+    
+    session.stats.promptTokens      = promptTokens;
+    session.stats.cachedTokens      = promptTokens;
+    session.stats.generatedTokens   = entry.generatedTokens;
+    session.stats.firstTokenMs      = session.timer.elapsed();
+    session.stats.decodeMs          = session.timer.elapsed();
+    session.stats.fromCache         = true;
+    
+    emit responseGenerated(session.id, QString::fromUtf8(text));
+    emit generationStats(session.id, session.stats);
+}
+
+void LlamaWorker::processCancellations() {
+    std::vector<int> ids;
+    {
+        QMutexLocker lock(&cancelMutex);
+        ids.swap(cancelRequests);
+        cancelPending = false;
+    }
+    const bool all = stopRequested.exchange(false);
+    
+    for (Session *session : activeSessions()) {
+        if (all || std::find(ids.begin(), ids.end(), session->id) != ids.end()) {
+            cancelSession(*session);
+        }
+    }
+}
+
+void LlamaWorker::cancelSession(Session &session) {
+    // Everything in `cachedTokens` is fully decoded, so the sequence stays usable
+    // for prefix reuse. A dropped answer is rolled back to the end of the prompt.
+    int n_keep = session.cachedTokens.size();
+    if (session.state == Session::State::Decode && !session.settings.keepPartial) {
+        n_keep = std::min(n_keep, session.responseStart);
+    }
+    
+    llama_memory_seq_rm(llama_get_memory(ctx), session.seq, n_keep, -1);
+    session.cachedTokens.resize(n_keep);
+    
+    const QString partial = session.state == Session::State::Decode && session.settings.keepPartial
+        ? QString::fromUtf8(session.response) : QString();
+    
+    session.state = Session::State::Idle;
+    session.pending = -1;
+    session.prompt.clear();
+    session.prompt.shrink_to_fit();
+    
+    emit generationCancelled(session.id, partial);
+}
+
+void LlamaWorker::rollbackBatch(const std::vector<Session *> &scheduled) {
+    // An aborted decode may have written some ubatches already, drop anything
+    // past what each session had cached before this step. The step is retried
+    // once the pending cancellations are handled.
+    llama_memory_t mem = llama_get_memory(ctx);
+    for (Session *session : scheduled) {
+        llama_memory_seq_rm(mem, session->seq, session->cachedTokens.size(), -1);
+    }
+    batch.n_tokens = 0;
+}
+
+std::vector<LlamaWorker::Session *> LlamaWorker::activeSessions() {
+    std::vector<Session *> active;
+    for (auto &entry : sessions) {
+        if (entry.second.state != Session::State::Idle) {
+            active.push_back(&entry.second);
+        }
+    }
+    if (active.empty()) {
+        return active;
+    }
      
-    std::vector<llama_token> tokens;
-    int n_tokens = -llama_tokenize(vocab, prompt_str.c_str(), prompt_str.size(), nullptr, 0, is_first, true);
+    // Rotate the start so equal-priority sessions take turns at the prefill budget.
+    roundRobin = (roundRobin + 1) % active.size();
+    std::rotate(active.begin(), active.begin() + roundRobin, active.end());
+    std::stable_sort(active.begin(), active.end(), [](const Session *a, const Session *b) {
+        return a->settings.priority > b->settings.priority;
+    });
+    return active;
+}
+
+bool LlamaWorker::assignSequence(Session &session) {
+    if (session.seq >= 0) {
+        return true;
+    }
+    
+    if (freeSeqs.empty()) {
+        // Take the sequence of the least recently used idle conversation.
+        Session *victim = nullptr;
+        for (auto &entry : sessions) {
+            Session &other = entry.second;
+            if (other.seq >= 0 && other.state == Session::State::Idle &&
+                (!victim || other.lastUsed < victim->lastUsed)) {
+                victim = &other;
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        releaseSequence(*victim);
+    }
     
-    if (n_tokens < 0) {
-        emit errorOccurred("Failed to tokenize prompt");
+    session.seq = freeSeqs.back();
+    freeSeqs.pop_back();
+    return true;
+}
+
+void LlamaWorker::releaseSequence(Session &session) {
+    if (session.seq < 0) {
         return;
     }
+    resetSessionCache(session);
+    freeSeqs.push_back(session.seq);
+    session.seq = -1;
+}
+
+void LlamaWorker::resetSessionCache(Session &session) {
+    if (ctx && session.seq >= 0) {
+        llama_memory_seq_rm(llama_get_memory(ctx), session.seq, -1, -1);
+    }
+    session.cachedTokens.clear();
+    session.shiftedTokens.clear();
+}
+
+int LlamaWorker::usedCells() const {
+    int used = 0;
+    for (const auto &entry : sessions) {
+        used += entry.second.cachedTokens.size();
+    }
+    return used;
+}
+
+bool LlamaWorker::reserveCells(Session &session, int n_tokens) {
+    const int n_ctx = llama_n_ctx(ctx);
+    
+    // Tokens already queued in the batch aren't cached yet but will take cells too.
+    n_tokens += batch.n_tokens;
+    
+    while (usedCells() + n_tokens > n_ctx) {
+        // Idle conversations give up their cache first, they can re-prefill later.
+        Session *victim = nullptr;
+        for (auto &entry : sessions) {
+            Session &other = entry.second;
+            if (&other != &session && other.state == Session::State::Idle && !other.cachedTokens.empty() &&
+                (!victim || other.lastUsed < victim->lastUsed)) {
+                victim = &other;
+            }
+        }
+        if (victim) {
+            resetSessionCache(*victim);
+            continue;
+        }
+        
+        return shiftContext(session, usedCells() + n_tokens - n_ctx);
+    }
+    return true;
+}
+
+bool LlamaWorker::growContext(int n_tokens) {
+    const int n_ctx    = llama_n_ctx(ctx);
+    const int n_needed = usedCells() + n_tokens;
+    if (n_needed <= n_ctx || n_ctx >= maxContext) {
+        return false;
+    }
+    
+    int n_grown = n_ctx;
+    while (n_grown < n_needed && n_grown < maxContext) {
+        n_grown *= 2;
+    }
+    n_grown = std::min(n_grown, maxContext);
+    TraceSpan span("llama.growContext");
     
-    tokens.resize(n_tokens);
-    if (llama_tokenize(vocab, prompt_str.c_str(), prompt_str.size(), tokens.data(), tokens.size(), is_first, true) < 0) {
-        emit errorOccurred("Failed to tokenize prompt");
+    // The new context is allocated before the old one is freed. If that runs out
+    // of memory the context stays at its size for good, and eviction and shifting
+    // take over as with a fixed context.
+    llama_context_params params = ctxParams;
+    params.n_ctx = n_grown;
+    llama_context *grown = initContext(model, params);
+    if (!grown) {
+        maxContext = n_ctx;
+        return false;
+    }
+    
+    std::vector<uint8_t> buffer;
+    for (auto &entry : sessions) {
+        Session &session = entry.second;
+        if (session.seq < 0 || session.cachedTokens.empty() ||
+            moveSequence(ctx, grown, session.seq, buffer)) {
+            continue;
+        }
+        
+        session.cachedTokens.clear();
+        session.shiftedTokens.clear();
+        if (session.state == Session::State::Prefill) {
+            session.promptPos          = 0;
+            session.stats.cachedTokens = 0;
+        } else if (session.state == Session::State::Decode) {
+            finishSession(session, "Lost the conversation state while growing the context");
+        }
+    }
+    llama_free(ctx);
+    ctx = grown;
+    ctxParams = params;
+    
+    if (draftCtx) {
+        params = draftCtxParams;
+        params.n_ctx = n_grown;
+        llama_context *draftGrown = initContext(draftModel, params);
+        if (draftGrown) {
+            if (!draftCachedTokens.empty() && !moveSequence(draftCtx, draftGrown, 0, buffer)) {
+                draftCachedTokens.clear();
+            }
+            llama_free(draftCtx);
+            draftCtx = draftGrown;
+            draftCtxParams = params;
+        }
+    }
+    return true;
+}
+
+bool LlamaWorker::moveSequence(llama_context *from, llama_context *to, llama_seq_id seq, std::vector<uint8_t> &buffer) {
+    buffer.resize(llama_state_seq_get_size(from, seq));
+    if (llama_state_seq_get_data(from, buffer.data(), buffer.size(), seq) != buffer.size()) {
+        return false;
+    }
+    if (llama_state_seq_set_data(to, buffer.data(), buffer.size(), seq) == 0) {
+        llama_memory_seq_rm(llama_get_memory(to), seq, -1, -1);
+        return false;
+    }
+    return true;
+}
+
+void LlamaWorker::closeSession(int sessionId) {
+    auto it = sessions.find(sessionId);
+    if (it == sessions.end()) {
         return;
     }
-     
-    llama_batch batch = llama_batch_get_one(tokens.data(), tokens.size());
-     
-    int n_ctx = llama_n_ctx(ctx);
-    int n_ctx_used = llama_memory_seq_pos_max(llama_get_memory(ctx), 0) + 1;
     
-    if (n_ctx_used + batch.n_tokens > n_ctx) {
-        emit errorOccurred("Context size exceeded");
+    releaseSequence(it->second);
+    sessions.erase(it);
+}
+
+void LlamaWorker::autoTune() {
+    if (!ctx || !model) {
+        emit errorOccurred("Load a model before auto-tuning");
+        return;
+    }
+    if (!activeSessions().empty()) {
+        emit errorOccurred("Wait for generation to finish before auto-tuning");
         return;
     }
     
-    if (llama_decode(ctx, batch) != 0) {
-        emit errorOccurred("Failed to evaluate prompt");
+    // Runs on throwaway contexts and blocks the worker until done, stop aborts it.
+    stopRequested = false;
+    AutoTuner tuner(model, stopRequested, poolLayout);
+    TuneResult result;
+    
+    bool ok = tuner.run([this](int step, int total, const QString &what) {
+        emit autoTuneProgress(step, total, what);
+    }, result);
+    
+    if (!ok) {
+        emit errorOccurred(stopRequested ? "Auto-tune cancelled" : "Auto-tune failed");
+        stopRequested = false;
         return;
     }
     
-    QString response;
-    int max_tokens = settings.maxTokens;
+    // Thread counts apply right away, the batch size needs a reload.
+    // Pools have a fixed size, so they are rebuilt for the new counts.
+    if (pools.create(result.threadCount, result.batchThreadCount, poolLayout)) {
+        pools.attach(ctx);
+        pools.attach(draftCtx);
+    }
+    llama_set_n_threads(ctx, result.threadCount, result.batchThreadCount);
+    for (llama_context_params *params : {&ctxParams, &draftCtxParams}) {
+        params->n_threads       = result.threadCount;
+        params->n_threads_batch = result.batchThreadCount;
+    }
+    if (draftCtx) {
+        llama_set_n_threads(draftCtx, result.threadCount, result.batchThreadCount);
+    }
     
-    for (int i = 0; i < max_tokens; i++) {
- 
-        llama_token new_token = llama_sampler_sample(sampler, ctx, -1);
-         
-        if (llama_vocab_is_eog(vocab, new_token)) {
-            break;
+    emit autoTuneFinished(result);
+}
+
+void LlamaWorker::saveSession(int sessionId, const QString &path, const ChatHistory &history) {
+    TraceSpan span("llama.saveSession");
+    SessionFile file;
+    file.modelFingerprint = modelFingerprint;
+    file.contextKey       = contextKey;
+    file.messages         = history.messages();
+    
+    const QString statePath = SessionFile::statePath(path);
+    QFile::remove(statePath);
+    
+    auto it = sessions.find(sessionId);
+    if (it != sessions.end()) {
+        Session &session = it->second;
+        
+        if (session.state != Session::State::Idle) {
+            emit sessionError(sessionId, "Can't save a session while it is generating");
+            return;
         }
-         
-        char buf[256];
-        int n = llama_token_to_piece(vocab, new_token, buf, sizeof(buf), 0, true);
         
-        if (n < 0) {
-            break;
+        // Without a cached sequence only the transcript is saved, it gets re-prefilled on restore.
+        if (ctx && session.seq >= 0 && !session.cachedTokens.empty()) {
+            if (llama_state_seq_save_file(ctx, statePath.toStdString().c_str(), session.seq,
+                                          session.cachedTokens.data(), session.cachedTokens.size()) == 0) {
+                emit sessionError(sessionId, "Failed to save KV state");
+                return;
+            }
+            file.tokenCount    = session.cachedTokens.size();
+            file.keepTokens    = session.keepTokens;
+            file.shiftedTokens = session.shiftedTokens;
         }
+    }
+    
+    QString error;
+    if (!file.save(path, &error)) {
+        QFile::remove(statePath);
+        emit sessionError(sessionId, error);
+        return;
+    }
+    
+    emit sessionSaved(sessionId, path);
+}
+
+void LlamaWorker::restoreSession(int sessionId, const QString &path) {
+    TraceSpan span("llama.restoreSession");
+    SessionFile file;
+    QString error;
+    
+    if (!file.load(path, &error)) {
+        emit sessionError(sessionId, error);
+        return;
+    }
+    
+    Session &session = sessions[sessionId];
+    session.id = sessionId;
+    
+    if (session.state != Session::State::Idle) {
+        emit sessionError(sessionId, "Can't restore into a session that is generating");
+        return;
+    }
+    
+    // A snapshot from another model or context layout is never loaded, the
+    // transcript is still restored and re-prefilled on the next turn.
+    bool stateRestored = false;
+    if (ctx && file.tokenCount > 0 &&
+        file.modelFingerprint == modelFingerprint && file.contextKey == contextKey &&
+        QFile::exists(SessionFile::statePath(path)) && assignSequence(session)) {
+        
+        stateRestored = loadSessionState(session, SessionFile::statePath(path), file.tokenCount);
+        if (stateRestored) {
+            session.keepTokens    = file.keepTokens;
+            session.shiftedTokens = file.shiftedTokens;
+        }
+    }
+    
+    emit sessionRestored(sessionId, file.messages, stateRestored);
+}
+
+bool LlamaWorker::loadSessionState(Session &session, const QString &path, int n_tokens) {
+    resetSessionCache(session);
+    
+    batch.n_tokens = 0;
+    growContext(n_tokens);
+    if (n_tokens > (int) llama_n_ctx(ctx) || !reserveCells(session, n_tokens)) {
+        return false;
+    }
+    
+    std::vector<llama_token> tokens(n_tokens);
+    size_t n_loaded = 0;
+    
+    if (llama_state_seq_load_file(ctx, path.toStdString().c_str(), session.seq,
+                                  tokens.data(), tokens.size(), &n_loaded) == 0) {
+        resetSessionCache(session);
+        return false;
+    }
+    
+    tokens.resize(n_loaded);
+    session.cachedTokens = std::move(tokens);
+    session.lastUsed     = ++useCounter;
+    return true;
+}
+
+std::vector<llama_token> LlamaWorker::tokenize(std::string_view text, bool add_special) {
+    TraceSpan span("llama.tokenize");
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    
+    int n_tokens = -llama_tokenize(vocab, text.data(), text.size(), nullptr, 0, add_special, true);
+    if (n_tokens <= 0) {
+        return {};
+    }
+    
+    std::vector<llama_token> tokens(n_tokens);
+    if (llama_tokenize(vocab, text.data(), text.size(), tokens.data(), tokens.size(), add_special, true) < 0) {
+        return {};
+    }
+    return tokens;
+}
+
+int LlamaWorker::countPinnedTokens(const char *tmpl, const std::vector<llama_chat_message> &messages,
+                                   const ChatHistory &history, const std::vector<llama_token> &tokens) {
+    size_t n_pinned = 0;
+    while (n_pinned < history.size() && history.pinned(n_pinned)) {
+        n_pinned++;
+    }
+    if (n_pinned == 0) {
+        return 0;
+    }
+     
+    std::string rendered;
+    if (!applyChatTemplate(tmpl, messages, n_pinned, false, rendered)) {
+        return 0;
+    }
+    std::vector<llama_token> pinned_tokens = tokenize(rendered, true);
+     
+    // Templates may render the last pinned message slightly differently once
+    // more turns follow, so only keep what the full prompt actually shares.
+    size_t n_keep = 0;
+    while (n_keep < pinned_tokens.size() && n_keep < tokens.size() &&
+           pinned_tokens[n_keep] == tokens[n_keep]) {
+        n_keep++;
+    }
+    return n_keep;
+}
+
+void LlamaWorker::restoreShiftedPrompt(Session &session, std::vector<llama_token> &tokens) {
+    if (session.shiftedTokens.empty()) {
+        return;
+    }
+     
+    // The cache no longer holds the evicted turns, cut the same span out of the
+    // new prompt so the rest of it still matches what is cached.
+    const size_t n_keep    = session.keepTokens;
+    const size_t n_shifted = session.shiftedTokens.size();
+    if (tokens.size() > n_keep + n_shifted && session.cachedTokens.size() >= n_keep &&
+        std::equal(session.cachedTokens.begin(), session.cachedTokens.begin() + n_keep, tokens.begin()) &&
+        std::equal(session.shiftedTokens.begin(), session.shiftedTokens.end(), tokens.begin() + n_keep)) {
+        tokens.erase(tokens.begin() + n_keep, tokens.begin() + n_keep + n_shifted);
+        return;
+    }
+     
+    // History diverged inside the evicted span, the cache gets trimmed instead.
+    session.shiftedTokens.clear();
+}
+
+bool LlamaWorker::shiftContext(Session &session, int n_discard_min) {
+    TraceSpan span("llama.shiftContext");
+    llama_memory_t mem = llama_get_memory(ctx);
+     
+    if (!session.settings.contextShift || !llama_memory_can_shift(mem)) {
+        return false;
+    }
+     
+    const int n_keep = session.keepTokens;
+    const int n_past = session.cachedTokens.size();
+    const int n_left = n_past - n_keep;
+     
+    // Evict half of the unpinned window, or more if the incoming tokens need it.
+    int n_discard = std::max(n_left / 2, n_discard_min);
+    if (n_left <= 0 || n_discard > n_left) {
+        return false;
+    }
+     
+    llama_memory_seq_rm (mem, session.seq, n_keep, n_keep + n_discard);
+    llama_memory_seq_add(mem, session.seq, n_keep + n_discard, n_past, -n_discard);
+     
+    auto evicted = session.cachedTokens.begin() + n_keep;
+    session.shiftedTokens.insert(session.shiftedTokens.end(), evicted, evicted + n_discard);
+    session.cachedTokens.erase(evicted, evicted + n_discard);
+    session.responseStart = std::max(n_keep, session.responseStart - n_discard);
+    return true;
+}
+
+int LlamaWorker::reuseCachedPrefix(Session &session, const std::vector<llama_token> &tokens) {
+    std::vector<llama_token> &cached = session.cachedTokens;
+    
+    size_t n_past = 0;
+    while (n_past < cached.size() && n_past < tokens.size() && cached[n_past] == tokens[n_past]) {
+        n_past++;
+    }
+     
+    // Re-evaluate at least the last prompt token so there are logits to sample from.
+    if (n_past == tokens.size() && n_past > 0) {
+        n_past--;
+    }
+     
+    // Drop everything after the common prefix, e.g. after the chat was cleared.
+    if (!llama_memory_seq_rm(llama_get_memory(ctx), session.seq, n_past, -1)) {
+        // Recurrent models can't trim a partial sequence, start over instead.
+        resetSessionCache(session);
+        n_past = 0;
+    }
+    
+    cached.resize(n_past);
+    return n_past;
+}
+
+std::vector<llama_token> LlamaWorker::draftTokens(const Session &session, int n_max) {
+    TraceSpan span("llama.draft");
+    std::vector<llama_token> draft;
+    
+    if (!draftCtx || n_max <= 0) {
+        return draft;
+    }
+     
+    // Bring the draft cache in line with the main sequence, then feed the last sampled token.
+    llama_memory_t mem = llama_get_memory(draftCtx);
+    const std::vector<llama_token> &cached = session.cachedTokens;
+    
+    size_t n_past = 0;
+    while (n_past < draftCachedTokens.size() && n_past < cached.size() &&
+           draftCachedTokens[n_past] == cached[n_past]) {
+        n_past++;
+    }
+    if (!llama_memory_seq_rm(mem, 0, n_past, -1)) {
+        llama_memory_clear(mem, true);
+        n_past = 0;
+    }
+    draftCachedTokens.resize(n_past);
+     
+    std::vector<llama_token> pending(cached.begin() + n_past, cached.end());
+    pending.push_back(session.pending);
+    
+    const int n_batch = llama_n_batch(draftCtx);
+    for (size_t i = 0; i < pending.size(); i += n_batch) {
+        int n_eval = std::min<int>(n_batch, pending.size() - i);
         
-        QString token_str = QString::fromUtf8(buf, n);
+        if (llama_decode(draftCtx, llama_batch_get_one(pending.data() + i, n_eval)) != 0) {
+            llama_memory_clear(mem, true);
+            draftCachedTokens.clear();
+            return draft;
+        }
+        draftCachedTokens.insert(draftCachedTokens.end(), pending.begin() + i, pending.begin() + i + n_eval);
+    }
+     
+    for (int i = 0; i < n_max; ++i) {
+        llama_token token = llama_sampler_sample(draftSampler, draftCtx, -1);
+        draft.push_back(token);
         
-        emit partialResponse(token_str);
-        response += token_str;
-         
-        n_ctx_used = llama_memory_seq_pos_max(llama_get_memory(ctx), 0) + 1;
-        if (n_ctx_used >= n_ctx - 1) {
-            emit errorOccurred("Context limit reached");
+        if (i + 1 == n_max || llama_vocab_is_eog(llama_model_get_vocab(draftModel), token)) {
             break;
         }
-         
-        batch = llama_batch_get_one(&new_token, 1);
-        
-        if (llama_decode(ctx, batch) != 0) {
-            emit errorOccurred("Failed to decode token");
+        if (llama_decode(draftCtx, llama_batch_get_one(&token, 1)) != 0) {
             break;
         }
+        draftCachedTokens.push_back(token);
+    }
+    
+    return draft;
+}
+
+bool LlamaWorker::appendPiece(Session &session, llama_token id) {
+    if (id < 0 || id >= pieces.size()) {
+        return false;
     }
     
-    emit responseGenerated(response);
+    // Raw UTF-8 all the way to the GUI, which decodes once per flush.
+    const std::string_view piece = pieces.piece(id);
+    session.response.append(piece.data(), piece.size());
+    if (stream.write(session.id, piece.data(), piece.size())) {
+        emit streamReady();
+    }
+    return true;
+}
+
+void LlamaWorker::batchAdd(llama_batch &batch, llama_token id, llama_pos pos, llama_seq_id seq, bool logits) {
+    batch.token   [batch.n_tokens]    = id;
+    batch.pos     [batch.n_tokens]    = pos;
+    batch.n_seq_id[batch.n_tokens]    = 1;
+    batch.seq_id  [batch.n_tokens][0] = seq;
+    batch.logits  [batch.n_tokens]    = logits;
+    batch.n_tokens++;
+}
+
+void LlamaWorker::requestStop() {
+    stopRequested = true;
+}
+
+void LlamaWorker::cancelGeneration(int sessionId) {
+    QMutexLocker lock(&cancelMutex);
+    cancelRequests.push_back(sessionId);
+    cancelPending = true;
 }
 
 void LlamaWorker::generateResponse(const QString &prompt, const GenerationSettings &settings) {
-    std::vector<ChatMessage> messages;
-    messages.push_back({"user", prompt});
-    generateResponseWithMessages(messages, settings);
+    ChatHistory history;
+    history.append("user", prompt);
+    generateResponseWithMessages(0, history, settings);
 }
 
 void LlamaWorker::cleanup() {
-    if (sampler) {
-        llama_sampler_free(sampler);
-        sampler = nullptr;
+    scheduler->stop();
+    if (ctx) {
+        for (Session *session : activeSessions()) {
+            cancelSession(*session);
+        }
+    }
+    stopRequested = false;
+    sessions.clear();
+    freeSeqs.clear();
+    pieces.clear();
+    modelFingerprint.clear();
+    contextKey.clear();
+    freeDraftModel();
+    if (batch.token) {
+        llama_batch_free(batch);
+        batch = {};
     }
     if (ctx) {
         llama_free(ctx);
         ctx = nullptr;
     }
+    pools.free();
     if (model) {
-        llama_model_free(model);
+        registry.release(model);
         model = nullptr;
     }
-    llama_backend_free();
-}
\ No newline at end of file
+}
@@ -3,27 +3,79 @@
 
 #include <QObject>
 #include <QString>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <vector>
+#include <map>
+#include <atomic>
 #include "llama.h"
+#include "promptlookup.h"
+#include "tokenstream.h"
+#include "modelregistry.h"
+#include "autotuner.h"
+#include "computepools.h"
+#include "fusedsampler.h"
+#include "vocabpieces.h"
+#include "chathistory.h"
+#include "metricschannel.h"
+#include "telemetry.h"
+#include "responsecache.h"
 
 struct GenerationSettings {
     int maxTokens       = 512;
     double temperature  = 0.7;
     double topP         = 0.9;
     int topK            = 40;
+    bool contextShift   = true;
+    bool promptLookup   = false;        // speculate by copying from earlier context
+    int lookupNgram     = 3;
+    int lookupTokens    = 10;
+    bool keepPartial    = true;         // keep the answer so far when generation is cancelled
+    int priority        = 0;            // higher-priority sessions get prefill budget first
 };
 
 struct ContextSettings {
     int contextSize     = 2048;
-    int threadCount     = 8;
+    int threadCount     = 8;            // decode
+    int batchThreadCount = 8;           // prompt processing
     int batchSize       = 512;
+    QString draftModelPath;             // optional small model for speculative decoding
+    int draftTokens     = 8;
+    int maxSessions     = 4;            // conversations sharing the context, one sequence each
+    bool elasticContext = false;        // start with a small KV cache and grow it up to contextSize
+    bool useMmap        = true;
+    bool useMlock       = false;        // keep weights resident, needs RLIMIT_MEMLOCK headroom
+    bool prefetch       = true;         // ask the kernel to read the model file ahead of the loader
+    bool warmup         = true;         // run one throwaway decode before reporting the model as loaded
+    int residentBudgetMb = 16384;       // models switched away from stay loaded up to this total
+    QString computeCores;               // e.g. "0-15", empty uses every core not in auxCores
+    QString auxCores;                   // GUI and speech recognition, kept off the compute cores
+    int numaStrategy    = 0;            // ggml_numa_strategy, fixed once the first model is loaded
+    int pollLevel       = 50;           // 0 sleeps between graphs, 100 busy-waits for the next one
+    bool strictCpu      = false;        // pin each compute thread to its own core
+    int kvCacheType     = GGML_TYPE_F16;    // f16, q8_0 or q4_0, quantized V needs flash attention
+    int flashAttention  = LLAMA_FLASH_ATTN_TYPE_AUTO;
+    int responseCacheMb = 64;           // answers kept for replay, 0 turns the cache off
+    QString responseCachePath;          // optional file the cache is also kept in
+    int responseCacheDiskMb = 1024;
 };
 
-struct ChatMessage {
-    QString role;
-    QString content;
+struct GenerationStats {
+    int promptTokens    = 0;
+    int cachedTokens    = 0;            // prompt tokens reused from the KV cache
+    int generatedTokens = 0;
+    int draftedTokens   = 0;
+    int acceptedTokens  = 0;
+    qint64 prefillMs    = 0;
+    qint64 firstTokenMs = 0;            // from request to first sampled token
+    qint64 decodeMs     = 0;
+    double energyJoules = 0.0;          // CPU package energy over the request, 0 without RAPL
+    bool fromCache      = false;        // replayed from the response cache, nothing was decoded
 };
 
+class QTimer;
+
 class LlamaWorker : public QObject
 {
     Q_OBJECT
@@ -32,25 +84,169 @@ public:
     LlamaWorker();
     ~LlamaWorker();
 
+    // Thread-safe, called directly from the GUI thread so they take effect
+    // within the current decode instead of waiting in the worker's event queue.
+    void requestStop();
+    void cancelGeneration(int sessionId);
+    
+    // Generated text is streamed through here rather than through signals,
+    // the GUI drains it at its own pace.
+    TokenStream *tokenStream() { return &stream; }
+    
+    // Optional, set before the worker thread starts.
+    void setMetrics(MetricsChannel *channel) { metrics = channel; }
+    void setEnergyCounter(EnergyCounter *counter) { energy = counter; }
+
 public slots:
     void loadModel(const QString &modelPath, const ContextSettings &settings);
     void generateResponse(const QString &prompt, const GenerationSettings &settings);
-    void generateResponseWithMessages(const std::vector<ChatMessage> &messages, const GenerationSettings &settings);
+    void generateResponseWithMessages(int sessionId, const ChatHistory &history, const GenerationSettings &settings);
+    void closeSession(int sessionId);
+    void autoTune();
+    void saveSession(int sessionId, const QString &path, const ChatHistory &history);
+    void restoreSession(int sessionId, const QString &path);
     void cleanup();
 
 signals:
     void modelLoaded();
-    void responseGenerated(const QString &response);
-    void partialResponse(const QString &token);
+    void loadProgress(int percent);
+    void loadTimings(qint64 loadMs, qint64 warmupMs);
+    void residentModelsChanged(const std::vector<ResidentModel> &models);
+    void autoTuneProgress(int step, int total, const QString &description);
+    void autoTuneFinished(const TuneResult &result);
+    void responseGenerated(int sessionId, const QString &response);
+    void streamReady();                 // enough unread tokens that the GUI shouldn't wait for its timer
+    void promptProgress(int sessionId, int processed, int total, double tokensPerSecond);
+    void generationStats(int sessionId, const GenerationStats &stats);
+    void sessionError(int sessionId, const QString &error);
+    void generationCancelled(int sessionId, const QString &partialResponse);
+    void sessionSaved(int sessionId, const QString &path);
+    void sessionRestored(int sessionId, const std::vector<ChatMessage> &messages, bool stateRestored);
+    void responseCacheStats(const ResponseCache::Stats &stats);
+    void warningOccurred(const QString &warning);   // loading carries on
     void errorOccurred(const QString &error);
 
 private:
+    static constexpr int ELASTIC_CONTEXT_START = 1024;
+    static constexpr int KV_SAMPLE_MS           = 250;
+    static constexpr int REPLAY_CHUNK           = 4096;     // bytes per token stream record
+    
+    // One conversation, evaluated in its own sequence of the shared context.
+    struct Session {
+        enum class State { Idle, Prefill, Decode };
+        
+        int id                          = 0;
+        llama_seq_id seq                = -1;
+        State state                     = State::Idle;
+        quint64 lastUsed                = 0;
+        
+        // Tokens currently evaluated in `seq`, used to skip re-prefilling
+        // the part of the conversation that has not changed since the last turn.
+        std::vector<llama_token> cachedTokens;
+        
+        // Context shifting state: the pinned prefix (system prompt, few-shot block)
+        // is never evicted, and the tokens evicted right after it are remembered so
+        // the next turn's prompt can be lined up with the shifted cache.
+        int keepTokens                  = 0;
+        std::vector<llama_token> shiftedTokens;
+        
+        GenerationSettings settings;
+        FusedSampler sampler;
+        PromptLookup lookup;
+        
+        std::vector<llama_token> prompt;
+        size_t promptPos                = 0;
+        int batchChunk                  = 0;
+        int batchIndex                  = -1;
+        llama_token pending             = -1;   // sampled, not yet decoded
+        int responseStart               = 0;    // cached tokens before the answer
+        
+        QByteArray response;            // raw UTF-8, pieces may split characters
+        int generated                   = 0;
+        GenerationStats stats;
+        QElapsedTimer timer;
+        quint64 energyStart             = 0;    // EnergyCounter reading when the request started
+        QByteArray cacheKey;            // set when the answer can go in the response cache
+    };
+
+    ModelRegistry registry;
+    VocabPieces pieces;
+    ComputePools pools;
+    PoolLayout poolLayout;
     llama_context *ctx;
     llama_model *model;
-    llama_sampler *sampler;
+    llama_batch batch;
+    
+    // Elastic contexts are recreated with these at twice the size as they fill up.
+    llama_context_params ctxParams;
+    llama_context_params draftCtxParams;
+    int maxContext;
+
+    // Draft model for speculative decoding, shares the main model's vocab.
+    llama_model *draftModel;
+    llama_context *draftCtx;
+    llama_sampler *draftSampler;
+    std::vector<llama_token> draftCachedTokens;
+    int draftLength;
+    int loadPercent;
+
+    // Identify what saved KV state is compatible with.
+    QString modelFingerprint;
+    QString contextKey;
+
+    std::map<int, Session> sessions;
+    std::vector<llama_seq_id> freeSeqs;
+    quint64 useCounter;
+    size_t roundRobin;
+    QTimer *scheduler;
+    TokenStream stream;
+    ResponseCache responseCache;
+    MetricsChannel *metrics;
+    EnergyCounter *energy;
+    QElapsedTimer kvSampleTimer;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> cancelPending;
+    QMutex cancelMutex;
+    std::vector<int> cancelRequests;
+    
+    void step();
+    void speculativeStep(Session &session);
+    std::vector<Session *> activeSessions();
+    bool assignSequence(Session &session);
+    void releaseSequence(Session &session);
+    int usedCells() const;
+    bool reserveCells(Session &session, int n_tokens);
+    bool growContext(int n_tokens);
+    llama_context *initContext(llama_model *model, const llama_context_params &params);
+    static bool moveSequence(llama_context *from, llama_context *to, llama_seq_id seq, std::vector<uint8_t> &buffer);
+    bool acceptToken(Session &session, llama_token id);
+    void finishSession(Session &session, const QString &error = QString());
+    QByteArray responseCacheKey(const Session &session, const std::vector<llama_token> &tokens) const;
+    void replayResponse(Session &session, const ResponseCache::Entry &entry, int promptTokens);
+    void processCancellations();
+    void cancelSession(Session &session);
+    void rollbackBatch(const std::vector<Session *> &scheduled);
+    void resetSessionCache(Session &session);
+    bool loadSessionState(Session &session, const QString &path, int n_tokens);
     
-    void updateSampler(const GenerationSettings &settings);
-    QString applyChatTemplate(const std::vector<ChatMessage> &messages, bool add_assistant);
+    static void updateSampler(FusedSampler &sampler, const GenerationSettings &settings);
+    std::vector<llama_token> tokenize(std::string_view text, bool add_special);
+    bool buildPrompt(const ChatHistory &history, std::vector<llama_token> &tokens, int &keepTokens);
+    int countPinnedTokens(const char *tmpl, const std::vector<llama_chat_message> &messages,
+                          const ChatHistory &history, const std::vector<llama_token> &tokens);
+    void restoreShiftedPrompt(Session &session, std::vector<llama_token> &tokens);
+    bool shiftContext(Session &session, int n_discard_min);
+    int reuseCachedPrefix(Session &session, const std::vector<llama_token> &tokens);
+    bool loadDraftModel(const ContextSettings &settings);
+    static void prefetchModelFile(const QString &path);
+    static PoolLayout makePoolLayout(const ContextSettings &settings);
+    static void warmupContext(llama_context *context, const llama_model *model);
+    void freeDraftModel();
+    std::vector<llama_token> draftTokens(const Session &session, int n_max);
+    bool appendPiece(Session &session, llama_token id);
+    static void batchAdd(llama_batch &batch, llama_token id, llama_pos pos, llama_seq_id seq, bool logits);
+    static bool applyChatTemplate(const char *tmpl, const std::vector<llama_chat_message> &messages,
+                                  size_t count, bool add_assistant, std::string &out);
 };
 
 #endif // LLAMAWORKER_H
\ No newline at end of file
@@ -47,6 +47,12 @@
 #include <QMainWindow>
 #include <QSettings>
 #include <QElapsedTimer>
+#include <QTimer>
+#include <QTabWidget>
+#include <QToolButton>
+#include <QListWidget>
+#include <QCryptographicHash>
+#include <QSysInfo>
 
 #include <QAudioSource>
 #include <QAudioFormat>
@@ -56,10 +62,18 @@
 #include "llamaworker.h"
 #include "whisperworker.h"
 #include "settingsdialog.h"
+#include "cpuaffinity.h"
+#include "memoryestimate.h"
+#include "performancedock.h"
+#include "trace.h"
+#include "telemetry.h"
  
 #include <poppler-document.h>
 #include <poppler-page.h>
 
+#include <algorithm>
+#include <map>
+
 
     // Thread comms. were managed with QThread signal and slotting, 
     // for ease of development, avoid using legacy MT ops.
@@ -103,12 +117,37 @@ private:
                                                                 /*maxTokens=*/      512,
                                                                 /*temperature=*/    0.3,
                                                                 /*topP=*/           0.95,
-                                                                /*topK=*/           10
+                                                                /*topK=*/           10,
+                                                                /*contextShift=*/   true,
+                                                                /*promptLookup=*/   false,
+                                                                /*lookupNgram=*/    3,
+                                                                /*lookupTokens=*/   10,
+                                                                /*keepPartial=*/    true
         };
         static inline const ContextSettings     CONTEXT         = {
                                                                 /*contextSize=*/    2048,
                                                                 /*threadCount=*/    8,
-                                                                /*batchSize=*/      512
+                                                                /*batchThreadCount=*/ 8,
+                                                                /*batchSize=*/      512,
+                                                                /*draftModelPath=*/ "",
+                                                                /*draftTokens=*/    8,
+                                                                /*maxSessions=*/    4,
+                                                                /*elasticContext=*/ false,
+                                                                /*useMmap=*/        true,
+                                                                /*useMlock=*/       false,
+                                                                /*prefetch=*/       true,
+                                                                /*warmup=*/         true,
+                                                                /*residentBudgetMb=*/ 16384,
+                                                                /*computeCores=*/   "",
+                                                                /*auxCores=*/       "",
+                                                                /*numaStrategy=*/   0,
+                                                                /*pollLevel=*/      50,
+                                                                /*strictCpu=*/      false,
+                                                                /*kvCacheType=*/    GGML_TYPE_F16,
+                                                                /*flashAttention=*/ LLAMA_FLASH_ATTN_TYPE_AUTO,
+                                                                /*responseCacheMb=*/ 64,
+                                                                /*responseCachePath=*/ "",
+                                                                /*responseCacheDiskMb=*/ 1024
         };
         static inline const WhisperSettings     WHISPER         = {
                                                                 /*printRealtime=*/   false,
@@ -127,6 +166,9 @@ private:
         };
 
         static constexpr int PDF_TRUNCATION_LENGTH              = 500;  
+        static constexpr int STREAM_INTERVAL_MS                 = 16;   // about one frame
+        static constexpr int STREAM_TOKENS                      = 32;
+        static constexpr int TELEMETRY_INTERVAL_MS              = 1000;
 
     };
         
@@ -157,6 +199,7 @@ private:
         static inline const QString HTML_SYSTEM         = "<i style='color: gray;'>%1</i>";
         static inline const QString HTML_SUCCESS        = "<i style='color: green;'>%1</i>";
         static inline const QString HTML_ERROR          = "<b style='color: red;'>Error:</b> %1";
+        static inline const QString HTML_WARNING        = "<b style='color: orange;'>Warning:</b> %1";
         static inline const QString HTML_INFO           = "<i style='color: cyan;'>%1</i>";
         static inline const QString HTML_LOADING        = "<i>%1</i>";
         static inline const QString HTML_USER           = "<b>You:</b> %1";
@@ -169,7 +212,11 @@ private:
 signals:
     void loadModel(const QString &modelPath, const ContextSettings &settings);
     void generateResponse(const QString &prompt, const GenerationSettings &settings);
-    void generateResponseWithMessages(const std::vector<ChatMessage> &messages, const GenerationSettings &settings);
+    void generateResponseWithMessages(int sessionId, const ChatHistory &history, const GenerationSettings &settings);
+    void closeSession(int sessionId);
+    void saveSession(int sessionId, const QString &path, const ChatHistory &history);
+    void restoreSession(int sessionId, const QString &path);
+    void autoTune();
     void loadWhisperModel(const QString &modelPath);
     void transcribeAudio(const std::vector<float> &audioData, const WhisperSettings &settings);
 
@@ -177,10 +224,13 @@ private:
     // Objects 
     QLineEdit           *modelPathEdit;
     QLineEdit           *userInput;
-    QTextEdit           *chatDisplay;
+    QTextEdit           *chatDisplay;       // display of the active conversation
+    QTabWidget          *chatTabs;
+    QListWidget         *residentList;
     QPushButton         *browseButton;
     QPushButton         *loadButton;
     QPushButton         *sendButton;
+    QPushButton         *stopButton;
     QPushButton         *uploadButton;
     QPushButton         *clearButton;
     QProgressBar        *progressBar;
@@ -197,13 +247,14 @@ private:
     QBuffer             *audioBuffer    = nullptr;
 
     QElapsedTimer       modelLoadTimer;
+    qint64              weightsLoadMs   = 0;    // reported by the worker, part of modelLoadTimer
+    qint64              warmupMs        = 0;
     QElapsedTimer       whisperLoadTimer;
     QByteArray          audioData;
 
     QString             savedModelPath;
     QString             savedWhisperPath;
     
-    QString             currentResponse;
     QString             systemPrompt;
     QString             fewShotExamples; 
     QString             lastUserMessage;
@@ -214,16 +265,47 @@ private:
 
     WhisperWorker       *whisperWorker;
     LlamaWorker         *worker;
+    
+    // Fed by both workers, only while the performance dock is open.
+    MetricsChannel      metrics;
+    PerformanceDock     *performanceDock = nullptr;
+    ResponseCache::Stats cacheStats;
+    
+    // Power and temperature, sampled on their own thread.
+    QThread             telemetryThread;
+    EnergyCounter       energy;
+    TelemetrySampler    *telemetry = nullptr;
+    int                 telemetryIntervalMs;
+    QString             telemetryLogPath;
 
     // Settings
     GenerationSettings  generationSettings;
     ContextSettings     contextSettings;
+    ContextSettings     loadedSettings;         // what the current model was loaded with, tuned profile included
 
     WhisperSettings     whisperSettings;
 
+    // Each chat tab is its own session on the worker, sharing the loaded model.
+    struct Conversation {
+        QTextEdit                   *display    = nullptr;
+        ChatHistory                 history;
+        QString                     currentResponse;
+        bool                        generating  = false;
+    };
+
+    std::map<int, Conversation> conversations;
+    int nextConversationId = 1;
+
     bool isRecording = false;
+    bool modelReady = false;
+    bool autoTuning = false;
     int pdfTruncationLength;
-    std::vector<ChatMessage> messageHistory;
+    
+    // Streamed tokens are drained from the worker at most once per interval,
+    // or earlier when this many are waiting.
+    QTimer *streamTimer = nullptr;
+    int streamIntervalMs;
+    int streamTokens;
     
 public:
 
@@ -232,15 +314,21 @@ public:
     // Default settings else modified settings.
 
         , systemPrompt          (Defaults::SYSTEM_PROMPT)
+        , telemetryIntervalMs   (Defaults::TELEMETRY_INTERVAL_MS)
         , generationSettings    (Defaults::GENERATION)
         , contextSettings       (Defaults::CONTEXT)
         , pdfTruncationLength   (Defaults::PDF_TRUNCATION_LENGTH) 
+        , streamIntervalMs      (Defaults::STREAM_INTERVAL_MS)
+        , streamTokens          (Defaults::STREAM_TOKENS)
         , modelPathEdit         (nullptr)
         , userInput             (nullptr)
         , chatDisplay           (nullptr)
+        , chatTabs              (nullptr)
+        , residentList          (nullptr)
         , browseButton          (nullptr)
         , loadButton            (nullptr)
         , sendButton            (nullptr)
+        , stopButton            (nullptr)
         , uploadButton          (nullptr)
         , clearButton           (nullptr)
         , progressBar           (nullptr)
@@ -258,7 +346,6 @@ public:
         , isRecording           (false)
         , savedModelPath        ("")
         , savedWhisperPath      ("")
-        , currentResponse       ("")
 
         
     {
@@ -266,6 +353,7 @@ public:
         setMinimumSize(Constants::DEFAULT_WINDOW_WIDTH, Constants::DEFAULT_WINDOW_HEIGHT);
          
         loadSavedSettings();
+        createPerformanceDock();
         createMenuBar();
          
         QWidget *centralWidget = new QWidget();
@@ -302,6 +390,8 @@ public:
         
         setupWorker();
         setupWhisperWorker();
+        setupTelemetry();
+        applyAuxAffinity(CpuAffinity::resolve(contextSettings.auxCores, contextSettings.computeCores));
 
         if (!savedModelPath.isEmpty()) {
             modelPathEdit->setText(savedModelPath);
@@ -326,13 +416,16 @@ public:
         }
          
         if (worker) {
-            worker->cleanup();
+            worker->requestStop();
+            QMetaObject::invokeMethod(worker, &LlamaWorker::cleanup, Qt::BlockingQueuedConnection);
         }
         
         workerThread.quit();
         workerThread.wait(1000);  
         whisperThread.quit();
         whisperThread.wait(1000);
+        telemetryThread.quit();
+        telemetryThread.wait(1000);
          
         if (workerThread.isRunning()) {
             workerThread.terminate();
@@ -358,11 +451,46 @@ private:
         
         fileMenu->addSeparator();
         
+        QAction *openChatAction = new QAction("&Open Conversation...", this);
+        openChatAction->setShortcut(QKeySequence::Open);
+        connect(openChatAction, &QAction::triggered, this, &ChatWindow::onOpenConversationClicked);
+        fileMenu->addAction(openChatAction);
+        
+        QAction *saveChatAction = new QAction("&Save Conversation...", this);
+        saveChatAction->setShortcut(QKeySequence::Save);
+        connect(saveChatAction, &QAction::triggered, this, &ChatWindow::onSaveConversationClicked);
+        fileMenu->addAction(saveChatAction);
+        
+        fileMenu->addSeparator();
+        
         QAction *exitAction = new QAction("E&xit", this);
         exitAction->setShortcut(QKeySequence("Ctrl+Q"));
         connect(exitAction, &QAction::triggered, this, &QWidget::close);
         fileMenu->addAction(exitAction);
 
+        QMenu *toolsMenu = menuBar->addMenu("&Tools");
+        
+        QAction *autoTuneAction = new QAction("&Auto-Tune Threads and Batch Size", this);
+        connect(autoTuneAction, &QAction::triggered, this, &ChatWindow::onAutoTuneClicked);
+        toolsMenu->addAction(autoTuneAction);
+        
+        toolsMenu->addSeparator();
+        
+        QAction *performanceAction = performanceDock->toggleViewAction();
+        performanceAction->setText("&Performance Panel");
+        performanceAction->setShortcut(QKeySequence("Ctrl+Shift+P"));
+        toolsMenu->addAction(performanceAction);
+        
+        QAction *traceAction = new QAction("Record &Trace", this);
+        traceAction->setCheckable(true);
+        traceAction->setChecked(Trace::enabled());
+        connect(traceAction, &QAction::toggled, this, [](bool checked) { Trace::setEnabled(checked); });
+        toolsMenu->addAction(traceAction);
+        
+        QAction *saveTraceAction = new QAction("Save Trace...", this);
+        connect(saveTraceAction, &QAction::triggered, this, &ChatWindow::onSaveTraceClicked);
+        toolsMenu->addAction(saveTraceAction);
+
         QMenu *helpMenu = menuBar->addMenu("&Help");
         
         QAction *aboutAction = new QAction("&About", this);
@@ -370,6 +498,12 @@ private:
         helpMenu->addAction(aboutAction);
     }
 
+    void createPerformanceDock() {
+        performanceDock = new PerformanceDock(&metrics, this);
+        addDockWidget(Qt::RightDockWidgetArea, performanceDock);
+        performanceDock->hide();
+    }
+
     void loadSavedSettings() {
         QSettings settings("Lunaria", "Lunaria");
         
@@ -383,12 +517,41 @@ private:
         generationSettings.temperature  = settings.value("generation/temperature",      Defaults::GENERATION.temperature).toDouble();
         generationSettings.topP         = settings.value("generation/topP",             Defaults::GENERATION.topP).toDouble();
         generationSettings.topK         = settings.value("generation/topK",             Defaults::GENERATION.topK).toInt();
+        generationSettings.contextShift = settings.value("generation/contextShift",     Defaults::GENERATION.contextShift).toBool();
+        generationSettings.promptLookup = settings.value("generation/promptLookup",     Defaults::GENERATION.promptLookup).toBool();
+        generationSettings.lookupNgram  = settings.value("generation/lookupNgram",      Defaults::GENERATION.lookupNgram).toInt();
+        generationSettings.lookupTokens = settings.value("generation/lookupTokens",     Defaults::GENERATION.lookupTokens).toInt();
+        generationSettings.keepPartial  = settings.value("generation/keepPartial",      Defaults::GENERATION.keepPartial).toBool();
 
         contextSettings.contextSize     = settings.value("context/size",                Defaults::CONTEXT.contextSize).toInt();
         contextSettings.threadCount     = settings.value("context/threads",             Defaults::CONTEXT.threadCount).toInt();
+        contextSettings.batchThreadCount = settings.value("context/batchThreads",       Defaults::CONTEXT.batchThreadCount).toInt();
         contextSettings.batchSize       = settings.value("context/batchSize",           Defaults::CONTEXT.batchSize).toInt();
+        contextSettings.maxSessions     = settings.value("context/maxSessions",         Defaults::CONTEXT.maxSessions).toInt();
+        contextSettings.elasticContext  = settings.value("context/elastic",             Defaults::CONTEXT.elasticContext).toBool();
+        contextSettings.useMmap         = settings.value("context/useMmap",             Defaults::CONTEXT.useMmap).toBool();
+        contextSettings.useMlock        = settings.value("context/useMlock",            Defaults::CONTEXT.useMlock).toBool();
+        contextSettings.prefetch        = settings.value("context/prefetch",            Defaults::CONTEXT.prefetch).toBool();
+        contextSettings.warmup          = settings.value("context/warmup",              Defaults::CONTEXT.warmup).toBool();
+        contextSettings.residentBudgetMb = settings.value("context/residentBudgetMb",   Defaults::CONTEXT.residentBudgetMb).toInt();
+        contextSettings.computeCores    = settings.value("context/computeCores",        Defaults::CONTEXT.computeCores).toString();
+        contextSettings.auxCores        = settings.value("context/auxCores",            Defaults::CONTEXT.auxCores).toString();
+        contextSettings.numaStrategy    = settings.value("context/numaStrategy",        Defaults::CONTEXT.numaStrategy).toInt();
+        contextSettings.pollLevel       = settings.value("context/pollLevel",           Defaults::CONTEXT.pollLevel).toInt();
+        contextSettings.strictCpu       = settings.value("context/strictCpu",           Defaults::CONTEXT.strictCpu).toBool();
+        contextSettings.kvCacheType     = settings.value("context/kvCacheType",         Defaults::CONTEXT.kvCacheType).toInt();
+        contextSettings.flashAttention  = settings.value("context/flashAttention",      Defaults::CONTEXT.flashAttention).toInt();
+        contextSettings.responseCacheMb = settings.value("context/responseCacheMb",     Defaults::CONTEXT.responseCacheMb).toInt();
+        contextSettings.responseCachePath = settings.value("context/responseCachePath", Defaults::CONTEXT.responseCachePath).toString();
+        contextSettings.responseCacheDiskMb = settings.value("context/responseCacheDiskMb", Defaults::CONTEXT.responseCacheDiskMb).toInt();
+        contextSettings.draftModelPath  = settings.value("context/draftModelPath",      Defaults::CONTEXT.draftModelPath).toString();
+        contextSettings.draftTokens     = settings.value("context/draftTokens",         Defaults::CONTEXT.draftTokens).toInt();
                 
         pdfTruncationLength             = settings.value("generation/pdfTruncation",    Defaults::PDF_TRUNCATION_LENGTH).toInt();
+        streamIntervalMs                = settings.value("display/streamInterval",      Defaults::STREAM_INTERVAL_MS).toInt();
+        streamTokens                    = settings.value("display/streamTokens",        Defaults::STREAM_TOKENS).toInt();
+        telemetryIntervalMs             = settings.value("telemetry/interval",          Defaults::TELEMETRY_INTERVAL_MS).toInt();
+        telemetryLogPath                = settings.value("telemetry/logPath").toString();
  
         whisperSettings.printRealtime   = settings.value("whisper/printRealtime",       Defaults::WHISPER.printRealtime).toBool();
         whisperSettings.printProgress   = settings.value("whisper/printProgress",       Defaults::WHISPER.printProgress).toBool();
@@ -417,12 +580,41 @@ private:
         settings.setValue               ("generation/temperature",      generationSettings.temperature);
         settings.setValue               ("generation/topP",             generationSettings.topP);
         settings.setValue               ("generation/topK",             generationSettings.topK);
+        settings.setValue               ("generation/contextShift",     generationSettings.contextShift);
+        settings.setValue               ("generation/promptLookup",     generationSettings.promptLookup);
+        settings.setValue               ("generation/lookupNgram",      generationSettings.lookupNgram);
+        settings.setValue               ("generation/lookupTokens",     generationSettings.lookupTokens);
+        settings.setValue               ("generation/keepPartial",      generationSettings.keepPartial);
         
         settings.setValue               ("context/size",                contextSettings.contextSize);
         settings.setValue               ("context/threads",             contextSettings.threadCount);
+        settings.setValue               ("context/batchThreads",        contextSettings.batchThreadCount);
         settings.setValue               ("context/batchSize",           contextSettings.batchSize);
+        settings.setValue               ("context/maxSessions",         contextSettings.maxSessions);
+        settings.setValue               ("context/elastic",             contextSettings.elasticContext);
+        settings.setValue               ("context/useMmap",             contextSettings.useMmap);
+        settings.setValue               ("context/useMlock",            contextSettings.useMlock);
+        settings.setValue               ("context/prefetch",            contextSettings.prefetch);
+        settings.setValue               ("context/warmup",              contextSettings.warmup);
+        settings.setValue               ("context/residentBudgetMb",    contextSettings.residentBudgetMb);
+        settings.setValue               ("context/computeCores",        contextSettings.computeCores);
+        settings.setValue               ("context/auxCores",            contextSettings.auxCores);
+        settings.setValue               ("context/numaStrategy",        contextSettings.numaStrategy);
+        settings.setValue               ("context/pollLevel",           contextSettings.pollLevel);
+        settings.setValue               ("context/strictCpu",           contextSettings.strictCpu);
+        settings.setValue               ("context/kvCacheType",         contextSettings.kvCacheType);
+        settings.setValue               ("context/flashAttention",      contextSettings.flashAttention);
+        settings.setValue               ("context/responseCacheMb",     contextSettings.responseCacheMb);
+        settings.setValue               ("context/responseCachePath",   contextSettings.responseCachePath);
+        settings.setValue               ("context/responseCacheDiskMb", contextSettings.responseCacheDiskMb);
+        settings.setValue               ("context/draftModelPath",      contextSettings.draftModelPath);
+        settings.setValue               ("context/draftTokens",         contextSettings.draftTokens);
         
         settings.setValue               ("generation/pdfTruncation",    pdfTruncationLength);  
+        settings.setValue               ("display/streamInterval",      streamIntervalMs);
+        settings.setValue               ("display/streamTokens",        streamTokens);
+        settings.setValue               ("telemetry/interval",          telemetryIntervalMs);
+        settings.setValue               ("telemetry/logPath",           telemetryLogPath);
 
         settings.setValue               ("whisper/printRealtime",       whisperSettings.printRealtime);
         settings.setValue               ("whisper/printProgress",       whisperSettings.printProgress);
@@ -469,6 +661,12 @@ private:
         progressBar->setVisible(false);
         modelLayout->addWidget(progressBar);
         
+        residentList        = new QListWidget();
+        residentList->setMaximumHeight(80);
+        residentList->setToolTip("Models kept in memory, double-click to switch instantly");
+        modelLayout->addWidget(new QLabel("Resident Models:"));
+        modelLayout->addWidget(residentList);
+        
         modelGroup->setLayout(modelLayout);
         layout->addWidget(modelGroup);
     }
@@ -513,14 +711,58 @@ private:
         auto *chatGroup     = new QGroupBox("Chat");
         auto *chatLayout    = new QVBoxLayout();
         
-        chatDisplay         = new QTextEdit();
-        chatDisplay->setReadOnly(true);
+        chatTabs            = new QTabWidget();
+        chatTabs->setDocumentMode(true);
+        chatTabs->setTabsClosable(true);
+        
+        auto *newChatButton = new QToolButton();
+        newChatButton->setText("+");
+        newChatButton->setToolTip("New Chat");
+        chatTabs->setCornerWidget(newChatButton, Qt::TopRightCorner);
         
-        chatLayout->addWidget(chatDisplay);
+        // First tab is added before the input widgets exist, so the tab
+        // change handler is only connected afterwards.
+        addConversation();
+        
+        connect(newChatButton,  &QToolButton::clicked,              this, &ChatWindow::onNewChatClicked);
+        connect(chatTabs,       &QTabWidget::tabCloseRequested,     this, &ChatWindow::onCloseChatRequested);
+        connect(chatTabs,       &QTabWidget::currentChanged,        this, &ChatWindow::onChatTabChanged);
+        
+        chatLayout->addWidget(chatTabs);
         chatGroup->setLayout(chatLayout);
         layout->addWidget(chatGroup);
     }
     
+    int addConversation() {
+        int id = nextConversationId++;
+        
+        Conversation &conversation  = conversations[id];
+        conversation.display        = new QTextEdit();
+        conversation.display->setReadOnly(true);
+        conversation.display->setProperty("conversationId", id);
+        
+        int index = chatTabs->addTab(conversation.display, QString("Chat %1").arg(id));
+        chatTabs->setCurrentIndex(index);
+        chatDisplay = conversation.display;
+        return id;
+    }
+    
+    int activeConversationId() const {
+        return chatTabs->currentWidget()->property("conversationId").toInt();
+    }
+    
+    Conversation &activeConversation() {
+        return conversations[activeConversationId()];
+    }
+    
+    void updateInputState() {
+        bool enabled = modelReady && !autoTuning && !activeConversation().generating;
+        userInput->setEnabled(enabled);
+        sendButton->setEnabled(enabled);
+        stopButton->setEnabled(modelReady && activeConversation().generating);
+        uploadButton->setEnabled(enabled);
+    }
+    
     void createInputSection(QVBoxLayout *layout) {
         auto *inputLayout   = new QHBoxLayout();
         
@@ -534,11 +776,15 @@ private:
         sendButton          = new QPushButton("Send");
         sendButton->setEnabled(false);
         
+        stopButton          = new QPushButton("Stop");
+        stopButton->setEnabled(false);
+        
         clearButton         = new QPushButton("Clear Chat");
         
         inputLayout->addWidget(userInput);
         inputLayout->addWidget(uploadButton);
         inputLayout->addWidget(sendButton);
+        inputLayout->addWidget(stopButton);
         inputLayout->addWidget(clearButton);
         
         layout->addLayout(inputLayout);
@@ -567,6 +813,7 @@ private:
     }
     
     QString extractTextFromPDF(const QString &filePath, int maxChars = -1) {
+        TraceSpan span("gui.extractPdf");
         if (maxChars == -1) {
             maxChars = pdfTruncationLength;  
         }
@@ -601,14 +848,24 @@ private:
     }
     
     void setupWorker() {
+        workerThread.setObjectName("LLM Worker");
         worker = new LlamaWorker();
+        worker->setMetrics(&metrics);
+        worker->setEnergyCounter(&energy);
         worker->moveToThread(&workerThread);
         
         connect(&workerThread,  &QThread::finished, worker, &QObject::deleteLater);
         
+        streamTimer = new QTimer(this);
+        streamTimer->setInterval(streamIntervalMs);
+        worker->tokenStream()->setThreshold(streamTokens);
+        connect(streamTimer,    &QTimer::timeout,               this, &ChatWindow::drainStream);
+        
         connect(browseButton,   &QPushButton::clicked,          this, &ChatWindow::onBrowseClicked);
         connect(loadButton,     &QPushButton::clicked,          this, &ChatWindow::onLoadModelClicked);
+        connect(residentList,   &QListWidget::itemDoubleClicked, this, &ChatWindow::onResidentModelActivated);
         connect(sendButton,     &QPushButton::clicked,          this, &ChatWindow::onSendClicked);
+        connect(stopButton,     &QPushButton::clicked,          this, &ChatWindow::onStopClicked);
         connect(uploadButton,   &QPushButton::clicked,          this, &ChatWindow::onUploadPDFClicked);
         connect(clearButton,    &QPushButton::clicked,          this, &ChatWindow::onClearChatClicked);
         connect(userInput,      &QLineEdit::returnPressed,      this, &ChatWindow::onSendClicked);
@@ -616,17 +873,38 @@ private:
         connect(this,           &ChatWindow::loadModel,                     worker, &LlamaWorker::loadModel);
         connect(this,           &ChatWindow::generateResponse,              worker, &LlamaWorker::generateResponse);
         connect(this,           &ChatWindow::generateResponseWithMessages,  worker, &LlamaWorker::generateResponseWithMessages);
+        connect(this,           &ChatWindow::closeSession,                  worker, &LlamaWorker::closeSession);
+        connect(this,           &ChatWindow::saveSession,                   worker, &LlamaWorker::saveSession);
+        connect(this,           &ChatWindow::restoreSession,                worker, &LlamaWorker::restoreSession);
+        connect(this,           &ChatWindow::autoTune,                      worker, &LlamaWorker::autoTune);
         
         connect(worker,         &LlamaWorker::modelLoaded,      this, &ChatWindow::onModelLoaded);
+        connect(worker,         &LlamaWorker::loadProgress,     this, &ChatWindow::onLoadProgress);
+        connect(worker,         &LlamaWorker::loadTimings,      this, &ChatWindow::onLoadTimings);
+        connect(worker,         &LlamaWorker::residentModelsChanged, this, &ChatWindow::onResidentModelsChanged);
+        connect(worker,         &LlamaWorker::autoTuneProgress, this, &ChatWindow::onAutoTuneProgress);
+        connect(worker,         &LlamaWorker::autoTuneFinished, this, &ChatWindow::onAutoTuneFinished);
         connect(worker,         &LlamaWorker::responseGenerated,this, &ChatWindow::onResponseGenerated);
-        connect(worker,         &LlamaWorker::partialResponse,  this, &ChatWindow::onPartialResponse);
+        connect(worker,         &LlamaWorker::streamReady,      this, &ChatWindow::drainStream);
+        connect(worker,         &LlamaWorker::promptProgress,   this, &ChatWindow::onPromptProgress);
+        connect(worker,         &LlamaWorker::generationStats,  this, &ChatWindow::onGenerationStats);
+        connect(worker,         &LlamaWorker::sessionError,     this, &ChatWindow::onSessionError);
+        connect(worker,         &LlamaWorker::generationCancelled, this, &ChatWindow::onGenerationCancelled);
+        connect(worker,         &LlamaWorker::sessionSaved,     this, &ChatWindow::onSessionSaved);
+        connect(worker,         &LlamaWorker::sessionRestored,  this, &ChatWindow::onSessionRestored);
+        connect(worker,         &LlamaWorker::warningOccurred,  this, &ChatWindow::onWarning);
         connect(worker,         &LlamaWorker::errorOccurred,    this, &ChatWindow::onError);
+        connect(worker,         &LlamaWorker::responseCacheStats, this, [this](const ResponseCache::Stats &stats) {
+            cacheStats = stats;
+        });
         
         workerThread.start();
     }
     
     void setupWhisperWorker() {
+        whisperThread.setObjectName("Whisper Worker");
         whisperWorker = new WhisperWorker();
+        whisperWorker->setMetrics(&metrics);
         whisperWorker->moveToThread(&whisperThread);
 
         connect(&whisperThread,     &QThread::finished, whisperWorker, &QObject::deleteLater);
@@ -645,6 +923,29 @@ private:
         whisperThread.start();
     }
     
+    void setupTelemetry() {
+        telemetryThread.setObjectName("Telemetry");
+        telemetry = new TelemetrySampler(&energy, &metrics);
+        telemetry->moveToThread(&telemetryThread);
+        
+        connect(&telemetryThread, &QThread::finished, telemetry, &QObject::deleteLater);
+        
+        telemetryThread.start();
+        QMetaObject::invokeMethod(telemetry, [telemetry = telemetry, interval = telemetryIntervalMs, path = telemetryLogPath]() {
+            telemetry->start(interval, path);
+        });
+    }
+    
+    // Keeps the GUI and speech recognition off the LLM compute cores. Threads they
+    // start afterwards, including whisper's compute threads, inherit the mask.
+    void applyAuxAffinity(const std::vector<int> &cores) {
+        CpuAffinity::pinCurrentThread(cores);
+        
+        QMetaObject::invokeMethod(whisperWorker, [cores]() {
+            CpuAffinity::pinCurrentThread(cores);
+        });
+    }
+    
     void setupAudioInput() {
         if (audioInput) {
             audioInput->stop();
@@ -706,13 +1007,28 @@ private slots:
          
         modelLoadTimer.start();
         
+        if (worker) {
+            worker->requestStop();
+        }
+        
         setProgressBarVisible(progressBar, true);
         setModelControlsEnabled(browseButton, loadButton, false);
         setStatus(llmStatusLabel, "Loading...", Styles::STATUS_LOADING);
         
         chatDisplay->append(Styles::HTML_LOADING.arg("Loading model..."));
         
-        emit loadModel(modelPath, contextSettings);
+        // A tuned profile only applies to this load, the saved settings stay the user's.
+        loadedSettings = contextSettings;
+        if (loadTunedProfile(modelPath, loadedSettings)) {
+            chatDisplay->append(Styles::HTML_SYSTEM.arg(QString("Using tuned profile: %1 threads, %2 batch threads, batch size %3")
+                .arg(loadedSettings.threadCount).arg(loadedSettings.batchThreadCount).arg(loadedSettings.batchSize)));
+        }
+        
+        const ModelShape shape = MemoryEstimate::readShape(modelPath);
+        chatDisplay->append(Styles::HTML_SYSTEM.arg("Estimated memory: " + MemoryEstimate::describe(shape,
+            loadedSettings.contextSize, loadedSettings.kvCacheType, loadedSettings.flashAttention)));
+        
+        emit loadModel(modelPath, loadedSettings);
     }
 
     void onWhisperLoadClicked() {
@@ -734,6 +1050,126 @@ private slots:
         emit loadWhisperModel(modelPath);
     }
         
+    void onLoadProgress(int percent) {
+        progressBar->setRange(0, 100);
+        progressBar->setValue(percent);
+        setProgressBarVisible(progressBar, true, false);
+    }
+    
+    void onLoadTimings(qint64 loadMs, qint64 warmupTimeMs) {
+        weightsLoadMs   = loadMs;
+        warmupMs        = warmupTimeMs;
+    }
+    
+    void onResidentModelsChanged(const std::vector<ResidentModel> &models) {
+        residentList->clear();
+        
+        for (const ResidentModel &resident : models) {
+            QString text = QString("%1 (%2 GiB)")
+                .arg(QFileInfo(resident.path).fileName())
+                .arg(resident.bytes / double(1 << 30), 0, 'f', 1);
+            if (resident.active) {
+                text += " - active";
+            }
+            
+            auto *item = new QListWidgetItem(text, residentList);
+            item->setData(Qt::UserRole, resident.path);
+            item->setToolTip(resident.path);
+        }
+    }
+    
+    void onResidentModelActivated(QListWidgetItem *item) {
+        if (!loadButton->isEnabled()) {
+            return;         // a load is already in progress
+        }
+        
+        modelPathEdit->setText(item->data(Qt::UserRole).toString());
+        onLoadModelClicked();
+    }
+    
+    // Tuned settings are kept per machine and model, a model file copied to
+    // another machine or swapped for another quant gets tuned again.
+    QString tuningKey(const QString &modelPath) const {
+        QFileInfo info(modelPath);
+        QByteArray machine = QSysInfo::machineUniqueId();
+        if (machine.isEmpty()) {
+            machine = QSysInfo::machineHostName().toUtf8();
+        }
+        QByteArray key = machine + '/' + info.fileName().toUtf8() + '/' + QByteArray::number(info.size());
+        return "tuning/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+    }
+    
+    bool loadTunedProfile(const QString &modelPath, ContextSettings &target) const {
+        QSettings settings("Lunaria", "Lunaria");
+        settings.beginGroup(tuningKey(modelPath));
+        
+        if (!settings.contains("threads")) {
+            return false;
+        }
+        
+        target.threadCount          = settings.value("threads").toInt();
+        target.batchThreadCount     = settings.value("batchThreads").toInt();
+        target.batchSize            = settings.value("batchSize").toInt();
+        return true;
+    }
+    
+    void onAutoTuneClicked() {
+        if (!modelReady) {
+            QMessageBox::information(this, "Auto-Tune", "Load a model first, it is tuned against the loaded model.");
+            return;
+        }
+        if (std::any_of(conversations.begin(), conversations.end(), [](const auto &entry) { return entry.second.generating; })) {
+            QMessageBox::information(this, "Auto-Tune", "Wait for the responses to finish before auto-tuning.");
+            return;
+        }
+        
+        autoTuning = true;
+        updateInputState();
+        setModelControlsEnabled(browseButton, loadButton, false);
+        setStatus(llmStatusLabel, "Auto-tuning...", Styles::STATUS_LOADING);
+        chatDisplay->append(Styles::HTML_LOADING.arg("Auto-tuning, this takes a minute..."));
+        
+        emit autoTune();
+    }
+    
+    void onAutoTuneProgress(int step, int total, const QString &description) {
+        progressBar->setRange(0, total);
+        progressBar->setValue(step);
+        setProgressBarVisible(progressBar, true, false);
+        setStatus(llmStatusLabel, description, Styles::STATUS_LOADING);
+    }
+    
+    void onAutoTuneFinished(const TuneResult &result) {
+        const bool reloadNeeded = result.batchSize != loadedSettings.batchSize;
+        
+        // The worker already runs with the new thread counts. The profile is
+        // stored per model and picked up on the next load.
+        loadedSettings.threadCount          = result.threadCount;
+        loadedSettings.batchThreadCount     = result.batchThreadCount;
+        
+        QSettings settings("Lunaria", "Lunaria");
+        settings.beginGroup(tuningKey(modelPathEdit->text()));
+        settings.setValue("threads",        result.threadCount);
+        settings.setValue("batchThreads",   result.batchThreadCount);
+        settings.setValue("batchSize",      result.batchSize);
+        settings.setValue("decodeTps",      result.decodeTps);
+        settings.setValue("prefillTps",     result.prefillTps);
+        settings.endGroup();
+        
+        setProgressBarVisible(progressBar, false);
+        setModelControlsEnabled(browseButton, loadButton, true);
+        setStatus(llmStatusLabel, "Ready", Styles::STATUS_READY);
+        autoTuning = false;
+        updateInputState();
+        
+        chatDisplay->append(Styles::HTML_SUCCESS.arg(QString("Tuned: %1 threads (%2 tok/s decode), %3 batch threads, batch size %4 (%5 tok/s prefill)")
+            .arg(result.threadCount).arg(result.decodeTps, 0, 'f', 1)
+            .arg(result.batchThreadCount).arg(result.batchSize).arg(result.prefillTps, 0, 'f', 1)));
+        if (reloadNeeded) {
+            chatDisplay->append(Styles::HTML_INFO.arg("Reload the model to apply the new batch size."));
+        }
+    }
+    
     void onModelLoaded() {
         qint64 loadTimeMs = modelLoadTimer.elapsed();
         
@@ -741,15 +1177,18 @@ private slots:
         setModelControlsEnabled(browseButton, loadButton, true);
         setStatus(llmStatusLabel, "Ready", Styles::STATUS_READY);
         
-        userInput->setEnabled(true);
-        sendButton->setEnabled(true);
-        uploadButton->setEnabled(true);
+        for (auto &entry : conversations) {
+            entry.second.history.clear();
+            entry.second.generating = false;
+        }
+        
+        modelReady = true;
+        updateInputState();
         
         chatDisplay->append(Styles::HTML_SUCCESS.arg("Success."));
-        chatDisplay->append(Styles::HTML_SYSTEM.arg(QString("Model loaded in %1 ms").arg(loadTimeMs)));
+        chatDisplay->append(Styles::HTML_SYSTEM.arg(QString("Model loaded in %1 ms (weights %2 ms, warmup %3 ms)")
+            .arg(loadTimeMs).arg(weightsLoadMs).arg(warmupMs)));
         chatDisplay->append(Styles::HTML_LOADING.arg("You can now start chatting.") + "\n");
-        
-        messageHistory.clear();   
     }
 
     void onWhisperModelLoaded() {
@@ -833,8 +1272,9 @@ private slots:
         QFileInfo fileInfo(fileName);
          
         QString pdfContext = QString("[PDF Content from %1]:\n%2").arg(fileInfo.fileName()).arg(extractedText);
-        messageHistory.push_back({"user", pdfContext});
-        messageHistory.push_back({"assistant", QString("I've loaded the PDF document '%1'. How can I help you with this content?").arg(fileInfo.fileName())});
+        ChatHistory &messageHistory = activeConversation().history;
+        messageHistory.append("user", pdfContext);
+        messageHistory.append("assistant", QString("I've loaded the PDF document '%1'. How can I help you with this content?").arg(fileInfo.fileName()));
         
         chatDisplay->append(Styles::HTML_PDF_LOADED.arg(fileInfo.fileName()).arg(pageCount));
         chatDisplay->append(Styles::HTML_INFO.arg(
@@ -849,6 +1289,7 @@ private slots:
     }
 
     void onSendClicked() {
+        TraceSpan span("gui.send");
         QString message = userInput->text().trimmed();
         
         if (message.isEmpty()) {
@@ -857,15 +1298,18 @@ private slots:
         
         lastUserMessage = message;
         
+        int conversationId = activeConversationId();
+        Conversation &conversation = conversations[conversationId];
+        ChatHistory &messageHistory = conversation.history;
+        conversation.generating = true;
+        
         chatDisplay->append(Styles::HTML_USER.arg(message));
         userInput->clear();
-        userInput->setEnabled(false);
-        sendButton->setEnabled(false);
-        uploadButton->setEnabled(false);
+        updateInputState();
         setStatus(llmStatusLabel, "Generating...", Styles::STATUS_LOADING);
          
         if (messageHistory.empty() && !systemPrompt.isEmpty()) {
-            messageHistory.push_back({"system", systemPrompt});
+            messageHistory.append("system", systemPrompt, true);
         }
          
         if (messageHistory.size() == 1 && !fewShotExamples.isEmpty()) {
@@ -879,7 +1323,7 @@ private slots:
                  
                 if (trimmedLine == "system" || trimmedLine == "user" || trimmedLine == "assistant") {
                     if (!currentRole.isEmpty() && !currentContent.isEmpty()) {
-                        messageHistory.push_back({currentRole, currentContent.trimmed()});
+                        messageHistory.append(currentRole, currentContent.trimmed(), true);
                     }
                     currentRole = trimmedLine;
                     currentContent.clear();
@@ -892,39 +1336,223 @@ private slots:
             }
              
             if (!currentRole.isEmpty() && !currentContent.isEmpty()) {
-                messageHistory.push_back({currentRole, currentContent.trimmed()});
+                messageHistory.append(currentRole, currentContent.trimmed(), true);
             }
         }
-        messageHistory.push_back({"user", message});
+        messageHistory.append("user", message);
         
         chatDisplay->append(Styles::HTML_LLM);
-        currentResponse.clear();
+        conversation.currentResponse.clear();
          
-        emit generateResponseWithMessages(messageHistory, generationSettings);
+        worker->tokenStream()->reset(conversationId);
+        streamTimer->start();
+        
+        emit generateResponseWithMessages(conversationId, messageHistory, generationSettings);
     }
 
-    void onPartialResponse(const QString &token) {
-        currentResponse += token;
+    void onPromptProgress(int sessionId, int processed, int total, double tokensPerSecond) {
+        if (sessionId != activeConversationId()) {
+            return;
+        }
+        
+        if (processed >= total) {
+            setProgressBarVisible(progressBar, false);
+            setStatus(llmStatusLabel, "Generating...", Styles::STATUS_LOADING);
+            return;
+        }
+        
+        progressBar->setRange(0, total);
+        progressBar->setValue(processed);
+        setProgressBarVisible(progressBar, true, false);
+        setStatus(llmStatusLabel, 
+            QString("Processing prompt %1/%2 (%3 tok/s)").arg(processed).arg(total).arg(tokensPerSecond, 0, 'f', 1), 
+            Styles::STATUS_LOADING);
+    }
+
+    void drainStream() {
+        TraceSpan span("gui.drainStream");
+        worker->tokenStream()->drain([this](int sessionId, const QString &text) {
+            appendStreamedText(sessionId, text);
+        });
+    }
+    
+    void appendStreamedText(int sessionId, const QString &text) {
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
+        
+        Conversation &conversation = it->second;
+        conversation.currentResponse += text;
          
-        QTextCursor cursor = chatDisplay->textCursor();
+        QTextCursor cursor = conversation.display->textCursor();
         cursor.movePosition(QTextCursor::End);
-        cursor.insertText(token);
-        chatDisplay->setTextCursor(cursor);
-        chatDisplay->ensureCursorVisible();
+        cursor.insertText(text);
+        conversation.display->setTextCursor(cursor);
+        conversation.display->ensureCursorVisible();
     }
     
-    void onResponseGenerated(const QString &response) {
-        chatDisplay->append("\n");
+    void onResponseGenerated(int sessionId, const QString &response) {
+        drainStream();
+        
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
+        
+        Conversation &conversation = it->second;
+        conversation.display->append("\n");
          
-        messageHistory.push_back({"assistant", currentResponse});
+        conversation.history.append("assistant", response);
+        conversation.generating = false;
+        
+        finishGeneration(sessionId);
+    }
+    
+    void onStopClicked() {
+        // Bypasses the worker's event queue, which is busy with the generation.
+        worker->cancelGeneration(activeConversationId());
+        stopButton->setEnabled(false);
+    }
+    
+    void onGenerationCancelled(int sessionId, const QString &partialResponse) {
+        drainStream();
+        
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
         
-        userInput->setEnabled(true);
-        sendButton->setEnabled(true);
-        uploadButton->setEnabled(true);
+        Conversation &conversation = it->second;
+        
+        // Without the partial answer, the user message it replied to is dropped too so
+        // the history keeps alternating.
+        if (!partialResponse.isEmpty()) {
+            conversation.history.append("assistant", partialResponse);
+        } else if (!conversation.history.empty() &&
+                   qstrcmp(conversation.history.role(conversation.history.size() - 1), "user") == 0) {
+            conversation.history.removeLast();
+        }
+        
+        conversation.display->append(Styles::HTML_SYSTEM.arg(partialResponse.isEmpty() ? "Stopped, answer discarded." : "Stopped."));
+        conversation.generating = false;
+        
+        finishGeneration(sessionId);
+    }
+    
+    void onSessionError(int sessionId, const QString &error) {
+        drainStream();
+        
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
+        
+        Conversation &conversation = it->second;
+        conversation.display->append(Styles::HTML_ERROR.arg(error));
+        conversation.generating = false;
+        
+        finishGeneration(sessionId);
+    }
+    
+    void finishGeneration(int sessionId) {
+        bool anyGenerating = std::any_of(conversations.begin(), conversations.end(),
+                                         [](const auto &entry) { return entry.second.generating; });
+        if (!anyGenerating) {
+            streamTimer->stop();
+        }
+        
+        if (sessionId != activeConversationId()) {
+            return;
+        }
+        
+        setProgressBarVisible(progressBar, false);
         setStatus(llmStatusLabel, "Ready", Styles::STATUS_READY);
+        updateInputState();
         userInput->setFocus();
     }
 
+    void onGenerationStats(int sessionId, const GenerationStats &stats) {
+        drainStream();
+        
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
+        
+        if (stats.fromCache) {
+            it->second.display->append(Styles::HTML_SYSTEM.arg(
+                QString("%1 tokens replayed from the response cache (%2 hits, %3 misses, %4 KiB saved)")
+                    .arg(stats.generatedTokens)
+                    .arg(cacheStats.hits)
+                    .arg(cacheStats.misses)
+                    .arg(cacheStats.bytesSaved / 1024)));
+            return;
+        }
+        
+        QString line = QString("%1 tokens, %2 tok/s, first token after %3 ms")
+            .arg(stats.generatedTokens)
+            .arg(stats.decodeMs > 0 ? stats.generatedTokens * 1000.0 / stats.decodeMs : 0.0, 0, 'f', 1)
+            .arg(stats.firstTokenMs);
+        
+        if (stats.draftedTokens > 0) {
+            line += QString(", draft acceptance %1% (%2/%3)")
+                .arg(100.0 * stats.acceptedTokens / stats.draftedTokens, 0, 'f', 1)
+                .arg(stats.acceptedTokens)
+                .arg(stats.draftedTokens);
+        }
+        
+        if (stats.energyJoules > 0.0 && stats.generatedTokens > 0) {
+            line += QString(", %1 J/token, %2 tok/W")
+                .arg(stats.energyJoules / stats.generatedTokens, 0, 'f', 2)
+                .arg(stats.generatedTokens / stats.energyJoules, 0, 'f', 2);
+            QMetaObject::invokeMethod(telemetry, [telemetry = telemetry, stats]() {
+                telemetry->logGeneration(stats.generatedTokens, stats.energyJoules, stats.decodeMs);
+            });
+        }
+        
+        it->second.display->append(Styles::HTML_SYSTEM.arg(line));
+    }
+    
+    void onNewChatClicked() {
+        addConversation();
+        chatDisplay->append(Styles::HTML_LOADING.arg("Starting fresh conversation.") + "\n");
+    }
+    
+    void onCloseChatRequested(int index) {
+        QWidget *display = chatTabs->widget(index);
+        int id = display->property("conversationId").toInt();
+        
+        if (conversations[id].generating) {
+            QMessageBox::information(this, "Chat", "Wait for the response to finish before closing this chat.");
+            return;
+        }
+        
+        // Always keep one conversation around.
+        if (chatTabs->count() == 1) {
+            addConversation();
+        }
+        
+        emit closeSession(id);
+        conversations.erase(id);
+        chatTabs->removeTab(chatTabs->indexOf(display));
+        display->deleteLater();
+    }
+    
+    void onChatTabChanged(int index) {
+        if (index < 0) {
+            return;
+        }
+        
+        chatDisplay = qobject_cast<QTextEdit *>(chatTabs->widget(index));
+        
+        bool generating = activeConversation().generating;
+        setProgressBarVisible(progressBar, false);
+        if (modelReady) {
+            setStatus(llmStatusLabel, generating ? "Generating..." : "Ready", generating ? Styles::STATUS_LOADING : Styles::STATUS_READY);
+        }
+        updateInputState();
+    }
     
     void onTranscriptionReady(const QString &text) {
         setStatus(whisperStatusLabel, "Ready", Styles::STATUS_READY);
@@ -939,7 +1567,7 @@ private slots:
     
     void onClearChatClicked() {
         chatDisplay->clear();
-        messageHistory.clear();   
+        activeConversation().history.clear();   
         chatDisplay->append(Styles::HTML_LOADING.arg("Chat history cleared. Starting fresh conversation.") + "\n");
     }
     
@@ -951,11 +1579,41 @@ private slots:
             dialog.setMaxTokens             (generationSettings.maxTokens);
             dialog.setContextSize           (contextSettings.contextSize);
             dialog.setThreadCount           (contextSettings.threadCount);
+            dialog.setBatchThreadCount      (contextSettings.batchThreadCount);
             dialog.setBatchSize             (contextSettings.batchSize);
+            dialog.setKvCacheType           (contextSettings.kvCacheType);
+            dialog.setFlashAttention        (contextSettings.flashAttention);
+            dialog.setModelPath             (modelPathEdit->text());
+            dialog.setMaxSessions           (contextSettings.maxSessions);
+            dialog.setElasticContext        (contextSettings.elasticContext);
+            dialog.setUseMmap               (contextSettings.useMmap);
+            dialog.setUseMlock              (contextSettings.useMlock);
+            dialog.setPrefetch              (contextSettings.prefetch);
+            dialog.setWarmup                (contextSettings.warmup);
+            dialog.setResidentBudget        (contextSettings.residentBudgetMb);
+            dialog.setComputeCores          (contextSettings.computeCores);
+            dialog.setAuxCores              (contextSettings.auxCores);
+            dialog.setNumaStrategy          (contextSettings.numaStrategy);
+            dialog.setPollLevel             (contextSettings.pollLevel);
+            dialog.setStrictCpu             (contextSettings.strictCpu);
+            dialog.setDraftModelPath        (contextSettings.draftModelPath);
+            dialog.setDraftTokens           (contextSettings.draftTokens);
+            dialog.setResponseCacheSize     (contextSettings.responseCacheMb);
+            dialog.setResponseCachePath     (contextSettings.responseCachePath);
+            dialog.setResponseCacheDiskSize (contextSettings.responseCacheDiskMb);
             dialog.setTemperature           (generationSettings.temperature);
             dialog.setTopP                  (generationSettings.topP);
             dialog.setTopK                  (generationSettings.topK);
+            dialog.setContextShift          (generationSettings.contextShift);
+            dialog.setPromptLookup          (generationSettings.promptLookup);
+            dialog.setLookupNgram           (generationSettings.lookupNgram);
+            dialog.setLookupTokens          (generationSettings.lookupTokens);
+            dialog.setKeepPartial           (generationSettings.keepPartial);
             dialog.setPdfTruncationLength   (pdfTruncationLength); 
+            dialog.setStreamInterval        (streamIntervalMs);
+            dialog.setStreamTokens          (streamTokens);
+            dialog.setTelemetryInterval     (telemetryIntervalMs);
+            dialog.setTelemetryLogPath      (telemetryLogPath);
             
             dialog.setWhisperPrintRealtime  (whisperSettings.printRealtime);
             dialog.setWhisperPrintProgress  (whisperSettings.printProgress);
@@ -979,12 +1637,47 @@ private slots:
             generationSettings.temperature  = dialog.getTemperature();
             generationSettings.topP         = dialog.getTopP();
             generationSettings.topK         = dialog.getTopK();
+            generationSettings.contextShift = dialog.getContextShift();
+            generationSettings.promptLookup = dialog.getPromptLookup();
+            generationSettings.lookupNgram  = dialog.getLookupNgram();
+            generationSettings.lookupTokens = dialog.getLookupTokens();
+            generationSettings.keepPartial  = dialog.getKeepPartial();
             pdfTruncationLength             = dialog.getPdfTruncationLength();  
+            streamIntervalMs                = dialog.getStreamInterval();
+            streamTokens                    = dialog.getStreamTokens();
+            streamTimer->setInterval(streamIntervalMs);
+            worker->tokenStream()->setThreshold(streamTokens);
+            
+            telemetryIntervalMs             = dialog.getTelemetryInterval();
+            telemetryLogPath                = dialog.getTelemetryLogPath();
+            QMetaObject::invokeMethod(telemetry, [telemetry = telemetry, interval = telemetryIntervalMs, path = telemetryLogPath]() {
+                telemetry->start(interval, path);
+            });
 
             ContextSettings newContextSettings;
             newContextSettings.contextSize  = dialog.getContextSize();
             newContextSettings.threadCount  = dialog.getThreadCount();
+            newContextSettings.batchThreadCount = dialog.getBatchThreadCount();
             newContextSettings.batchSize    = dialog.getBatchSize();
+            newContextSettings.kvCacheType  = dialog.getKvCacheType();
+            newContextSettings.flashAttention = dialog.getFlashAttention();
+            newContextSettings.maxSessions  = dialog.getMaxSessions();
+            newContextSettings.elasticContext = dialog.getElasticContext();
+            newContextSettings.useMmap      = dialog.getUseMmap();
+            newContextSettings.useMlock     = dialog.getUseMlock();
+            newContextSettings.prefetch     = dialog.getPrefetch();
+            newContextSettings.warmup       = dialog.getWarmup();
+            newContextSettings.residentBudgetMb = dialog.getResidentBudget();
+            newContextSettings.computeCores = dialog.getComputeCores();
+            newContextSettings.auxCores     = dialog.getAuxCores();
+            newContextSettings.numaStrategy = dialog.getNumaStrategy();
+            newContextSettings.pollLevel    = dialog.getPollLevel();
+            newContextSettings.strictCpu    = dialog.getStrictCpu();
+            newContextSettings.draftModelPath = dialog.getDraftModelPath();
+            newContextSettings.draftTokens  = dialog.getDraftTokens();
+            newContextSettings.responseCacheMb = dialog.getResponseCacheSize();
+            newContextSettings.responseCachePath = dialog.getResponseCachePath();
+            newContextSettings.responseCacheDiskMb = dialog.getResponseCacheDiskSize();
 
             whisperSettings.printRealtime   = dialog.getWhisperPrintRealtime();
             whisperSettings.printProgress   = dialog.getWhisperPrintProgress();
@@ -1000,9 +1693,36 @@ private slots:
             whisperSettings.splitOnWord     = dialog.getWhisperSplitOnWord();
             whisperSettings.suppressBlank   = dialog.getWhisperSuppressBlank();
             
+            // Applied on the next load, without asking for a reload.
+            contextSettings.residentBudgetMb = newContextSettings.residentBudgetMb;
+            contextSettings.numaStrategy     = newContextSettings.numaStrategy;
+            contextSettings.responseCacheMb  = newContextSettings.responseCacheMb;
+            contextSettings.responseCachePath = newContextSettings.responseCachePath;
+            contextSettings.responseCacheDiskMb = newContextSettings.responseCacheDiskMb;
+            
+            if (newContextSettings.auxCores     != contextSettings.auxCores ||
+                newContextSettings.computeCores != contextSettings.computeCores) {
+                contextSettings.auxCores = newContextSettings.auxCores;
+                applyAuxAffinity(CpuAffinity::resolve(newContextSettings.auxCores, newContextSettings.computeCores));
+            }
+            
             if (newContextSettings.contextSize  != contextSettings.contextSize ||
                 newContextSettings.threadCount  != contextSettings.threadCount ||
-                newContextSettings.batchSize    != contextSettings.batchSize) {
+                newContextSettings.batchThreadCount != contextSettings.batchThreadCount ||
+                newContextSettings.batchSize    != contextSettings.batchSize ||
+                newContextSettings.kvCacheType  != contextSettings.kvCacheType ||
+                newContextSettings.flashAttention != contextSettings.flashAttention ||
+                newContextSettings.maxSessions  != contextSettings.maxSessions ||
+                newContextSettings.elasticContext != contextSettings.elasticContext ||
+                newContextSettings.useMmap      != contextSettings.useMmap ||
+                newContextSettings.useMlock     != contextSettings.useMlock ||
+                newContextSettings.prefetch     != contextSettings.prefetch ||
+                newContextSettings.warmup       != contextSettings.warmup ||
+                newContextSettings.computeCores != contextSettings.computeCores ||
+                newContextSettings.pollLevel    != contextSettings.pollLevel ||
+                newContextSettings.strictCpu    != contextSettings.strictCpu ||
+                newContextSettings.draftModelPath != contextSettings.draftModelPath ||
+                newContextSettings.draftTokens  != contextSettings.draftTokens) {
                 
                 contextSettings = newContextSettings;
                 
@@ -1018,6 +1738,86 @@ private slots:
         }
     }
 
+    void onSaveConversationClicked() {
+        Conversation &conversation = activeConversation();
+        
+        if (conversation.generating) {
+            QMessageBox::information(this, "Save Conversation", "Wait for the response to finish before saving.");
+            return;
+        }
+        
+        QString path = QFileDialog::getSaveFileName(this, "Save Conversation", QDir::homePath(), "Lunaria Sessions (*.lunaria)");
+        if (path.isEmpty()) {
+            return;
+        }
+        if (!path.endsWith(".lunaria")) {
+            path += ".lunaria";
+        }
+        
+        emit saveSession(activeConversationId(), path, conversation.history);
+    }
+    
+    void onOpenConversationClicked() {
+        QString path = QFileDialog::getOpenFileName(this, "Open Conversation", QDir::homePath(), "Lunaria Sessions (*.lunaria)");
+        if (path.isEmpty()) {
+            return;
+        }
+        
+        int id = addConversation();
+        chatTabs->setTabText(chatTabs->currentIndex(), QFileInfo(path).completeBaseName());
+        chatDisplay->append(Styles::HTML_LOADING.arg("Restoring conversation..."));
+        
+        emit restoreSession(id, path);
+    }
+    
+    void onSessionSaved(int sessionId, const QString &path) {
+        auto it = conversations.find(sessionId);
+        if (it != conversations.end()) {
+            it->second.display->append(Styles::HTML_SUCCESS.arg(QString("Conversation saved to %1").arg(path)));
+        }
+    }
+    
+    void onSessionRestored(int sessionId, const std::vector<ChatMessage> &messages, bool stateRestored) {
+        auto it = conversations.find(sessionId);
+        if (it == conversations.end()) {
+            return;
+        }
+        
+        Conversation &conversation = it->second;
+        conversation.history = ChatHistory::fromMessages(messages);
+        conversation.display->clear();
+        
+        for (const ChatMessage &message : messages) {
+            if (message.role == "user") {
+                conversation.display->append(Styles::HTML_USER.arg(message.content));
+            } else if (message.role == "assistant") {
+                conversation.display->append(Styles::HTML_LLM);
+                QTextCursor cursor = conversation.display->textCursor();
+                cursor.movePosition(QTextCursor::End);
+                cursor.insertText(message.content);
+                conversation.display->append("\n");
+            }
+        }
+        
+        conversation.display->append(Styles::HTML_SYSTEM.arg(stateRestored
+            ? "Conversation restored with its cached context."
+            : "Conversation restored. Its cached context doesn't match the loaded model or settings, it will be re-processed on the next message."));
+    }
+    
+    void onSaveTraceClicked() {
+        QString path = QFileDialog::getSaveFileName(this, "Save Trace", QDir::homePath(), "Chrome Trace (*.json)");
+        if (path.isEmpty()) {
+            return;
+        }
+        
+        QString error;
+        if (Trace::dump(path, &error)) {
+            chatDisplay->append(Styles::HTML_SUCCESS.arg(QString("Trace saved to %1, open it in Perfetto.").arg(path)));
+        } else {
+            chatDisplay->append(Styles::HTML_ERROR.arg(error));
+        }
+    }
+    
     void onAboutClicked() {
         QMessageBox msgBox(this);
         msgBox.setWindowTitle("About Lunaria");
@@ -1039,11 +1839,12 @@ private slots:
         
         chatDisplay->append(Styles::HTML_ERROR.arg(error));
          
-        if (worker) {
-            userInput->setEnabled(true);
-            sendButton->setEnabled(true);
-            uploadButton->setEnabled(true);
-        }
+        autoTuning = false;
+        updateInputState();
+    }
+    
+    void onWarning(const QString &warning) {
+        chatDisplay->append(Styles::HTML_WARNING.arg(warning));
     }
     
     void onWhisperError(const QString &error) {
@@ -1059,6 +1860,7 @@ private slots:
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    QThread::currentThread()->setObjectName("GUI");
     
     app.setApplicationName("Lunaria");
     app.setApplicationVersion("1.0");
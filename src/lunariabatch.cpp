@@ -0,0 +1,336 @@
+// Runs a JSON Lines file of chat requests through LlamaWorker without any
+// widgets. Up to --parallel requests share the context as separate sessions
+// and are batched together by the worker; a new one is started as soon as
+// any finishes, and results are written in the order they complete. Only
+// the requests in flight are held in memory, so the input can be any size.
+//
+//   lunaria-batch --model model.gguf --input requests.jsonl [--output results.jsonl] [--parallel 4]
+//
+// Input lines are ChatRequest objects, optionally with an "id" that is copied
+// to the result. Blank lines are skipped, every other line gets one result:
+//
+//   {"id": ..., "line": 3, "response": "...", "promptTokens": 41, "generatedTokens": 128, ...}
+//   {"id": ..., "line": 4, "error": "..."}
+
+#include "chatrequest.h"
+#include "llamaworker.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+namespace {
+
+constexpr int STREAM_THRESHOLD  = 256;      // tokens between discards of the unused stream
+
+// Reads requests one line at a time and writes one result line per request.
+class BatchRunner
+{
+public:
+    BatchRunner(LlamaWorker *worker, QFile &input, QFile &output, const GenerationSettings &defaults,
+                int maxTokensLimit, int parallel)
+        : worker(worker), input(input), output(output), defaults(defaults), maxTokensLimit(maxTokensLimit),
+          parallel(parallel) {}
+
+    void start();
+    bool finished() const { return inputDone && inFlight.empty(); }
+
+    void onResponse(int sessionId, const QString &response);
+    void onStats(int sessionId, const GenerationStats &stats);
+    void onError(int sessionId, const QString &error);
+
+    int completed   = 0;
+    int failed      = 0;
+    qint64 generatedTokens = 0;
+
+private:
+    struct Request {
+        QJsonValue id;
+        int line;
+        QString response;
+    };
+
+    LlamaWorker *worker;
+    QFile &input;
+    QFile &output;
+    GenerationSettings defaults;
+    int maxTokensLimit;
+    int parallel;
+
+    std::map<int, Request> inFlight;        // by session id
+    bool inputDone  = false;
+    int lineNumber  = 0;
+    int nextSession = 1;
+
+    void submitNext();
+    void finish(int sessionId, QJsonObject result);
+};
+
+void BatchRunner::start() {
+    while (!inputDone && (int) inFlight.size() < parallel) {
+        submitNext();
+    }
+}
+
+// Starts the next request in the file, writing an error result for lines
+// that can't be parsed and moving on to the one after.
+void BatchRunner::submitNext() {
+    while (!input.atEnd()) {
+        const QByteArray line = input.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        const QJsonObject json = document.object();
+
+        ChatRequest request;
+        QString error;
+        if (!document.isObject()) {
+            error = parseError.error != QJsonParseError::NoError ? parseError.errorString() : "Not a JSON object";
+        } else {
+            ChatRequest::fromJson(json, defaults, maxTokensLimit, request, &error);
+        }
+
+        const int sessionId = nextSession++;
+        inFlight[sessionId] = {json.value("id"), lineNumber, QString()};
+
+        if (!error.isEmpty()) {
+            QJsonObject result;
+            result["error"] = error;
+            ++failed;
+            finish(sessionId, result);
+            continue;
+        }
+
+        QMetaObject::invokeMethod(worker, [worker = worker, sessionId, request]() {
+            worker->generateResponseWithMessages(sessionId, request.history, request.settings);
+        });
+        return;
+    }
+    inputDone = true;
+}
+
+void BatchRunner::onResponse(int sessionId, const QString &response) {
+    auto it = inFlight.find(sessionId);
+    if (it != inFlight.end()) {
+        it->second.response = response;
+    }
+}
+
+void BatchRunner::onStats(int sessionId, const GenerationStats &stats) {
+    auto it = inFlight.find(sessionId);
+    if (it == inFlight.end()) {
+        return;
+    }
+
+    QJsonObject result;
+    result["response"]          = it->second.response;
+    result["promptTokens"]      = stats.promptTokens;
+    result["generatedTokens"]   = stats.generatedTokens;
+    result["firstTokenMs"]      = stats.firstTokenMs;
+    result["decodeTps"]         = stats.decodeMs > 0 ? stats.generatedTokens * 1000.0 / stats.decodeMs : 0.0;
+    if (stats.energyJoules > 0.0) {
+        result["joules"]        = stats.energyJoules;
+    }
+    if (stats.fromCache) {
+        result["cached"]        = true;
+    }
+    generatedTokens += stats.generatedTokens;
+
+    QMetaObject::invokeMethod(worker, [worker = worker, sessionId]() { worker->closeSession(sessionId); });
+    finish(sessionId, result);
+    start();
+}
+
+void BatchRunner::onError(int sessionId, const QString &error) {
+    if (inFlight.count(sessionId) == 0) {
+        return;
+    }
+
+    QJsonObject result;
+    result["error"] = error;
+    ++failed;
+
+    QMetaObject::invokeMethod(worker, [worker = worker, sessionId]() { worker->closeSession(sessionId); });
+    finish(sessionId, result);
+    start();
+}
+
+void BatchRunner::finish(int sessionId, QJsonObject result) {
+    auto it = inFlight.find(sessionId);
+    if (!it->second.id.isUndefined()) {
+        result["id"] = it->second.id;
+    }
+    result["line"] = it->second.line;
+    inFlight.erase(it);
+    ++completed;
+
+    output.write(QJsonDocument(result).toJson(QJsonDocument::Compact));
+    output.write("\n");
+    output.flush();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("lunaria-batch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs a JSON Lines file of chat requests, writes one result line per request.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"model",           "LLM model (GGUF).", "path"},
+        {"input",           "Requests, one JSON object per line.", "path"},
+        {"output",          "Write results here instead of stdout.", "path"},
+        {"parallel",        "Requests generated at the same time.", "n", "4"},
+        {"ctx",             "Context size shared by all parallel requests, default 2048 each.", "n"},
+        {"threads",         "Decode and prompt processing threads.", "n"},
+        {"batch",           "Batch size.", "n"},
+        {"max-tokens",      "Default max_tokens.", "n", "512"},
+        {"temperature",     "Default temperature.", "t", "0.7"},
+        {"cache-mb",        "Response cache in memory, 0 turns it off.", "n", "64"},
+        {"cache-file",      "Also keep the response cache in this file.", "path"},
+    });
+    parser.process(app);
+
+    if (!parser.isSet("model") || !parser.isSet("input")) {
+        std::fprintf(stderr, "lunaria-batch: --model and --input are required.\n");
+        return 2;
+    }
+
+    QFile input(parser.value("input"));
+    if (!input.open(QFile::ReadOnly)) {
+        std::fprintf(stderr, "lunaria-batch: failed to open %s\n", qPrintable(input.fileName()));
+        return 1;
+    }
+
+    QFile output;
+    bool opened;
+    if (parser.isSet("output")) {
+        output.setFileName(parser.value("output"));
+        opened = output.open(QFile::WriteOnly | QFile::Truncate);
+    } else {
+        opened = output.open(stdout, QFile::WriteOnly);
+    }
+    if (!opened) {
+        std::fprintf(stderr, "lunaria-batch: failed to open %s\n", qPrintable(parser.value("output")));
+        return 1;
+    }
+
+    const int parallel = std::clamp(parser.value("parallel").toInt(), 1, 64);
+
+    ContextSettings contextSettings;
+    contextSettings.maxSessions = parallel;
+    contextSettings.contextSize = parser.isSet("ctx") ? parser.value("ctx").toInt() : 2048 * parallel;
+    contextSettings.warmup      = false;
+    if (parser.isSet("threads")) {
+        contextSettings.threadCount      = parser.value("threads").toInt();
+        contextSettings.batchThreadCount = contextSettings.threadCount;
+    }
+    if (parser.isSet("batch")) {
+        contextSettings.batchSize = parser.value("batch").toInt();
+    }
+    contextSettings.responseCacheMb     = parser.value("cache-mb").toInt();
+    contextSettings.responseCachePath   = parser.value("cache-file");
+
+    GenerationSettings defaults;
+    defaults.maxTokens      = std::clamp(parser.value("max-tokens").toInt(), 1, contextSettings.contextSize);
+    defaults.temperature    = parser.value("temperature").toDouble();
+
+    QThread thread;
+    thread.setObjectName("LLM Worker");
+    EnergyCounter energy;
+    LlamaWorker *worker = new LlamaWorker();
+    worker->setEnergyCounter(&energy);
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+
+    // Nothing reads the streamed text, it is discarded on the worker thread
+    // so the stream's overflow buffer doesn't grow. Results come whole
+    // through responseGenerated.
+    worker->tokenStream()->setThreshold(STREAM_THRESHOLD);
+    auto discardStream = [worker]() { worker->tokenStream()->drain([](int, const QString &) {}); };
+    QObject::connect(worker, &LlamaWorker::streamReady, worker, discardStream, Qt::DirectConnection);
+    QObject::connect(worker, &LlamaWorker::generationStats, worker, [worker, discardStream](int sessionId) {
+        discardStream();
+        worker->tokenStream()->reset(sessionId);
+    }, Qt::DirectConnection);
+    QObject::connect(worker, &LlamaWorker::sessionError, worker, [worker, discardStream](int sessionId) {
+        discardStream();
+        worker->tokenStream()->reset(sessionId);
+    }, Qt::DirectConnection);
+
+    ResponseCache::Stats cacheStats;
+    QObject::connect(worker, &LlamaWorker::responseCacheStats, &app, [&](const ResponseCache::Stats &stats) {
+        cacheStats = stats;
+    });
+
+    bool loaded = false;
+    QString loadError;
+    QObject context;
+    QObject::connect(worker, &LlamaWorker::modelLoaded,   &context, [&]() { loaded = true; });
+    QObject::connect(worker, &LlamaWorker::warningOccurred, &context, [](const QString &message) {
+        std::fprintf(stderr, "lunaria-batch: warning: %s\n", qPrintable(message));
+    });
+    QObject::connect(worker, &LlamaWorker::errorOccurred, &context, [&](const QString &message) {
+        loadError = message;
+        loaded = true;
+    });
+
+    const QString modelPath = parser.value("model");
+    QMetaObject::invokeMethod(worker, [=]() { worker->loadModel(modelPath, contextSettings); });
+    while (!loaded) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+
+    int status = 0;
+    if (!loadError.isEmpty()) {
+        std::fprintf(stderr, "lunaria-batch: %s\n", qPrintable(loadError));
+        status = 1;
+    } else {
+        BatchRunner runner(worker, input, output, defaults, contextSettings.contextSize, parallel);
+        QObject::connect(worker, &LlamaWorker::responseGenerated, &context, [&](int id, const QString &response) {
+            runner.onResponse(id, response);
+        });
+        QObject::connect(worker, &LlamaWorker::generationStats, &context, [&](int id, const GenerationStats &stats) {
+            runner.onStats(id, stats);
+        });
+        QObject::connect(worker, &LlamaWorker::sessionError, &context, [&](int id, const QString &error) {
+            runner.onError(id, error);
+        });
+
+        QElapsedTimer wall;
+        wall.start();
+        runner.start();
+        while (!runner.finished()) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+        }
+
+        const double seconds = wall.elapsed() / 1000.0;
+        std::fprintf(stderr, "lunaria-batch: %d requests, %d failed, %lld tokens in %.1f s (%.1f tok/s)\n",
+                     runner.completed, runner.failed, (long long) runner.generatedTokens, seconds,
+                     seconds > 0.0 ? runner.generatedTokens / seconds : 0.0);
+        if (cacheStats.hits > 0) {
+            std::fprintf(stderr, "lunaria-batch: %llu answers replayed from the response cache, %llu tokens not decoded\n",
+                         (unsigned long long) cacheStats.hits, (unsigned long long) cacheStats.tokensSaved);
+        }
+        status = runner.failed > 0 ? 1 : 0;
+    }
+
+    QMetaObject::invokeMethod(worker, &LlamaWorker::cleanup, Qt::BlockingQueuedConnection);
+    thread.quit();
+    thread.wait();
+    return status;
+}
@@ -0,0 +1,465 @@
+// Drives LlamaWorker and WhisperWorker without any widgets and prints the
+// results as JSON, so builds from different LlamaFlags.sh variants can be
+// compared run against run.
+//
+//   lunaria-bench --model model.gguf [--prompt-tokens 128,512,2048] [--gen-tokens 128] [--runs 3]
+//                 [--whisper-model ggml-base.en.bin --wav a.wav --wav b.wav] [--output result.json]
+
+#include "llamaworker.h"
+#include "whisperworker.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QThread>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr int LOAD_TIMEOUT_MS       = 10 * 60 * 1000;
+constexpr int GENERATE_TIMEOUT_MS   = 30 * 60 * 1000;
+
+// Processes events until `done` is set by one of the handlers, or the timeout.
+bool waitUntil(const bool &done, int timeoutMs) {
+    QElapsedTimer timer;
+    timer.start();
+    while (!done && timer.elapsed() < timeoutMs) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+    return done;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t index = std::min(values.size() - 1, size_t(p * (values.size() - 1) + 0.5));
+    return values[index];
+}
+
+// Roughly one token per word with common tokenizers, the count reported is
+// the real one from the worker. The run number up front keeps a later run
+// from reusing an earlier one's KV cache.
+QString makePrompt(int n_tokens, int run) {
+    static const QStringList words = QString(
+        "the quick brown fox jumps over the lazy dog while a small bird sings in the old "
+        "tree near the river and the farmer walks his cattle back to the barn before dark").split(' ');
+
+    QString prompt = QString("Run %1. Summarize the following text in detail:\n").arg(run);
+    for (int i = 0; i < n_tokens; ++i) {
+        prompt += words.at(i % words.size());
+        prompt += (i % 16 == 15) ? ".\n" : " ";
+    }
+    return prompt;
+}
+
+quint32 readLe(const char *data, int size) {
+    quint32 value = 0;
+    for (int i = size - 1; i >= 0; --i) {
+        value = (value << 8) | uchar(data[i]);
+    }
+    return value;
+}
+
+// 16-bit PCM or 32-bit float WAV, mixed down to mono and linearly resampled
+// to what whisper expects.
+bool readWav(const QString &path, std::vector<float> &samples, QString *error) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        *error = QString("Failed to open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE") {
+        *error = QString("%1 is not a WAV file").arg(path);
+        return false;
+    }
+
+    int format = 0, channels = 0, rate = 0, bits = 0;
+    QByteArray pcm;
+    for (int pos = 12; pos + 8 <= data.size();) {
+        const QByteArray id = data.mid(pos, 4);
+        const int size = readLe(data.constData() + pos + 4, 4);
+        const char *body = data.constData() + pos + 8;
+
+        if (id == "fmt " && size >= 16) {
+            format   = readLe(body, 2);
+            channels = readLe(body + 2, 2);
+            rate     = readLe(body + 4, 4);
+            bits     = readLe(body + 14, 2);
+        } else if (id == "data") {
+            pcm = data.mid(pos + 8, size);
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+    const bool int16   = format == 1 && bits == 16;
+    const bool float32 = format == 3 && bits == 32;
+    if ((!int16 && !float32) || channels <= 0 || rate <= 0 || pcm.isEmpty()) {
+        *error = QString("%1: only 16-bit PCM and 32-bit float WAV are supported").arg(path);
+        return false;
+    }
+
+    const int frameSize = channels * bits / 8;
+    const size_t frames = pcm.size() / frameSize;
+    std::vector<float> mono(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        const char *frame = pcm.constData() + i * frameSize;
+        float sum = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            if (int16) {
+                int16_t value;
+                std::memcpy(&value, frame + c * 2, 2);
+                sum += value / 32768.0f;
+            } else {
+                float value;
+                std::memcpy(&value, frame + c * 4, 4);
+                sum += value;
+            }
+        }
+        mono[i] = sum / channels;
+    }
+
+    if (rate == WHISPER_SAMPLE_RATE) {
+        samples = std::move(mono);
+        return true;
+    }
+
+    const double step = double(rate) / WHISPER_SAMPLE_RATE;
+    samples.resize(size_t(frames / step));
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const double pos = i * step;
+        const size_t j = size_t(pos);
+        const double frac = pos - j;
+        samples[i] = j + 1 < frames ? mono[j] * (1.0 - frac) + mono[j + 1] * frac : mono[j];
+    }
+    return true;
+}
+
+bool benchLlama(const QCommandLineParser &parser, QJsonObject &result, QString *error) {
+    std::vector<int> promptLengths;
+    for (const QString &value : parser.value("prompt-tokens").split(',', Qt::SkipEmptyParts)) {
+        promptLengths.push_back(std::max(1, value.trimmed().toInt()));
+    }
+    if (promptLengths.empty()) {
+        *error = "--prompt-tokens needs at least one length";
+        return false;
+    }
+    const int genTokens = std::max(1, parser.value("gen-tokens").toInt());
+    const int runs      = std::max(1, parser.value("runs").toInt());
+
+    ContextSettings contextSettings;
+    const int longest = *std::max_element(promptLengths.begin(), promptLengths.end());
+    contextSettings.contextSize = parser.isSet("ctx") ? parser.value("ctx").toInt()
+                                                      : std::max(2048, longest * 2 + genTokens + 256);
+    if (parser.isSet("threads")) {
+        contextSettings.threadCount      = parser.value("threads").toInt();
+        contextSettings.batchThreadCount = contextSettings.threadCount;
+    }
+    if (parser.isSet("batch")) {
+        contextSettings.batchSize = parser.value("batch").toInt();
+    }
+    contextSettings.responseCacheMb = 0;    // every run has to decode
+
+    GenerationSettings generationSettings;
+    generationSettings.maxTokens    = genTokens;
+    generationSettings.contextShift = false;
+
+    QThread thread;
+    EnergyCounter energy;
+    LlamaWorker *worker = new LlamaWorker();
+    worker->setEnergyCounter(&energy);
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+
+    bool loaded = false;
+    bool failed = false;
+    qint64 loadMs = 0, warmupMs = 0;
+    QObject context;
+    QObject::connect(worker, &LlamaWorker::modelLoaded,  &context, [&]() { loaded = true; });
+    QObject::connect(worker, &LlamaWorker::loadTimings,  &context, [&](qint64 load, qint64 warmup) {
+        loadMs   = load;
+        warmupMs = warmup;
+    });
+    QObject::connect(worker, &LlamaWorker::errorOccurred, &context, [&](const QString &message) {
+        *error = message;
+        failed = loaded = true;
+    });
+
+    // Every token is stamped on the worker thread as it is streamed, the
+    // drain keeps each write reporting back.
+    std::vector<qint64> stamps;
+    QElapsedTimer clock;
+    clock.start();
+    worker->tokenStream()->setThreshold(1);
+    QObject::connect(worker, &LlamaWorker::streamReady, worker, [&]() {
+        stamps.push_back(clock.nsecsElapsed());
+        worker->tokenStream()->drain([](int, const QString &) {});
+    }, Qt::DirectConnection);
+
+    const QString modelPath = parser.value("model");
+    QElapsedTimer wall;
+    wall.start();
+    QMetaObject::invokeMethod(worker, [=]() { worker->loadModel(modelPath, contextSettings); });
+
+    bool ok = waitUntil(loaded, LOAD_TIMEOUT_MS) && !failed;
+    const qint64 wallLoadMs = wall.elapsed();
+
+    QJsonArray prompts;
+    for (size_t p = 0; ok && p < promptLengths.size(); ++p) {
+        std::vector<double> ttft, prefill, decode, gaps;
+        int promptTokens = 0;
+        int generated    = 0;
+        double joules    = 0.0;
+
+        for (int run = 0; ok && run < runs; ++run) {
+            const int sessionId = int(p) * runs + run + 1;
+            bool done = false;
+            GenerationStats stats;
+
+            QObject runContext;
+            QObject::connect(worker, &LlamaWorker::generationStats, &runContext, [&](int id, const GenerationStats &s) {
+                if (id == sessionId) {
+                    stats = s;
+                    done  = true;
+                }
+            });
+            QObject::connect(worker, &LlamaWorker::sessionError, &runContext, [&](int id, const QString &message) {
+                if (id == sessionId) {
+                    *error = message;
+                    failed = done = true;
+                }
+            });
+
+            ChatHistory history;
+            history.append("user", makePrompt(promptLengths[p], run));
+            stamps.clear();
+            QMetaObject::invokeMethod(worker, [=]() {
+                worker->generateResponseWithMessages(sessionId, history, generationSettings);
+            });
+
+            ok = waitUntil(done, GENERATE_TIMEOUT_MS) && !failed;
+            QMetaObject::invokeMethod(worker, [=]() { worker->closeSession(sessionId); });
+            if (!ok) {
+                break;
+            }
+
+            const int evaluated = stats.promptTokens - stats.cachedTokens;
+            promptTokens = stats.promptTokens;
+            generated   += stats.generatedTokens;
+            joules      += stats.energyJoules;
+            ttft.push_back(stats.firstTokenMs);
+            prefill.push_back(stats.prefillMs > 0 ? evaluated * 1000.0 / stats.prefillMs : 0.0);
+            decode.push_back(stats.decodeMs > 0 ? stats.generatedTokens * 1000.0 / stats.decodeMs : 0.0);
+            for (size_t i = 1; i < stamps.size(); ++i) {
+                gaps.push_back((stamps[i] - stamps[i - 1]) / 1e6);
+            }
+        }
+
+        if (ok) {
+            QJsonObject entry;
+            entry["requestedTokens"]    = promptLengths[p];
+            entry["promptTokens"]       = promptTokens;
+            entry["generatedTokens"]    = double(generated) / runs;
+            entry["timeToFirstTokenMs"] = percentile(ttft, 0.5);
+            entry["prefillTps"]         = percentile(prefill, 0.5);
+            entry["decodeTps"]          = percentile(decode, 0.5);
+            entry["interTokenP50Ms"]    = percentile(gaps, 0.5);
+            entry["interTokenP99Ms"]    = percentile(gaps, 0.99);
+            if (joules > 0.0 && generated > 0) {
+                entry["joulesPerToken"] = joules / generated;
+            }
+            prompts.append(entry);
+        }
+    }
+
+    thread.quit();
+    thread.wait();
+
+    if (!ok) {
+        if (error->isEmpty()) {
+            *error = "LLM benchmark timed out";
+        }
+        return false;
+    }
+
+    result["model"]         = QFileInfo(modelPath).fileName();
+    result["contextSize"]   = contextSettings.contextSize;
+    result["threads"]       = contextSettings.threadCount;
+    result["batchSize"]     = contextSettings.batchSize;
+    result["runs"]          = runs;
+    result["loadMs"]        = loadMs;
+    result["warmupMs"]      = warmupMs;
+    result["wallLoadMs"]    = wallLoadMs;
+    result["prompts"]       = prompts;
+    return true;
+}
+
+bool benchWhisper(const QCommandLineParser &parser, QJsonObject &result, QString *error) {
+    WhisperSettings settings = {
+        /*printRealtime=*/   false,
+        /*printProgress=*/   false,
+        /*printTimestamps=*/ false,
+        /*printSpecial=*/    false,
+        /*translate=*/       false,
+        /*language=*/        "en",
+        /*threads=*/         4,
+        /*offsetMs=*/        0,
+        /*durationMs=*/      0,
+        /*tokenTimestamps=*/ false,
+        /*maxLen=*/          1,
+        /*splitOnWord=*/     true,
+        /*suppressBlank=*/   true
+    };
+    if (parser.isSet("whisper-threads")) {
+        settings.threads = parser.value("whisper-threads").toInt();
+    }
+
+    QThread thread;
+    WhisperWorker *worker = new WhisperWorker();
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+
+    bool done   = false;
+    bool failed = false;
+    QObject context;
+    QObject::connect(worker, &WhisperWorker::modelLoaded,        &context, [&]() { done = true; });
+    QObject::connect(worker, &WhisperWorker::transcriptionReady, &context, [&]() { done = true; });
+    QObject::connect(worker, &WhisperWorker::errorOccurred,      &context, [&](const QString &message) {
+        *error = message;
+        failed = done = true;
+    });
+
+    const QString modelPath = parser.value("whisper-model");
+    QElapsedTimer timer;
+    timer.start();
+    QMetaObject::invokeMethod(worker, [=]() { worker->loadModel(modelPath); });
+    bool ok = waitUntil(done, LOAD_TIMEOUT_MS) && !failed;
+    const qint64 loadMs = timer.elapsed();
+
+    QJsonArray files;
+    for (const QString &path : parser.values("wav")) {
+        if (!ok) {
+            break;
+        }
+        std::vector<float> samples;
+        if (!readWav(path, samples, error)) {
+            ok = false;
+            break;
+        }
+
+        done = false;
+        timer.restart();
+        QMetaObject::invokeMethod(worker, [=]() { worker->transcribe(samples, settings); });
+        ok = waitUntil(done, GENERATE_TIMEOUT_MS) && !failed;
+        const qint64 transcribeMs = timer.elapsed();
+
+        if (ok) {
+            const double audioSeconds = double(samples.size()) / WHISPER_SAMPLE_RATE;
+            QJsonObject entry;
+            entry["file"]           = QFileInfo(path).fileName();
+            entry["audioSeconds"]   = audioSeconds;
+            entry["transcribeMs"]   = transcribeMs;
+            entry["realTimeFactor"] = audioSeconds > 0.0 ? transcribeMs / 1000.0 / audioSeconds : 0.0;
+            files.append(entry);
+        }
+    }
+
+    thread.quit();
+    thread.wait();
+
+    if (!ok) {
+        if (error->isEmpty()) {
+            *error = "Whisper benchmark timed out";
+        }
+        return false;
+    }
+
+    result["model"]     = QFileInfo(modelPath).fileName();
+    result["threads"]   = settings.threads;
+    result["loadMs"]    = loadMs;
+    result["files"]     = files;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("lunaria-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless LLM and Whisper benchmark, prints JSON.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"model",           "LLM model (GGUF).", "path"},
+        {"prompt-tokens",   "Comma-separated prompt lengths.", "list", "128,512,2048"},
+        {"gen-tokens",      "Tokens generated per run.", "n", "128"},
+        {"runs",            "Runs per prompt length, medians are reported.", "n", "3"},
+        {"ctx",             "Context size, default fits the longest prompt.", "n"},
+        {"threads",         "Decode and prompt processing threads.", "n"},
+        {"batch",           "Batch size.", "n"},
+        {"whisper-model",   "Whisper model.", "path"},
+        {"whisper-threads", "Whisper threads.", "n"},
+        {"wav",             "WAV fixture, may be repeated.", "path"},
+        {"output",          "Write the JSON here instead of stdout.", "path"},
+    });
+    parser.process(app);
+
+    if (!parser.isSet("model") && !parser.isSet("whisper-model")) {
+        std::fprintf(stderr, "Nothing to benchmark, pass --model and/or --whisper-model.\n");
+        return 2;
+    }
+
+    QJsonObject root;
+    root["timestamp"]   = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["host"]        = QSysInfo::machineHostName();
+    root["cpu"]         = QSysInfo::currentCpuArchitecture();
+    root["cores"]       = QThread::idealThreadCount();
+    root["llamaSystem"] = QString::fromUtf8(llama_print_system_info()).trimmed();
+
+    QString error;
+    bool ok = true;
+
+    if (parser.isSet("model")) {
+        QJsonObject llm;
+        ok = benchLlama(parser, llm, &error);
+        root["llm"] = llm;
+    }
+    if (ok && parser.isSet("whisper-model")) {
+        QJsonObject whisper;
+        ok = benchWhisper(parser, whisper, &error);
+        whisper["system"] = QString::fromUtf8(whisper_print_system_info()).trimmed();
+        root["whisper"] = whisper;
+    }
+
+    if (!ok) {
+        std::fprintf(stderr, "lunaria-bench: %s\n", qPrintable(error));
+        return 1;
+    }
+
+    const QByteArray json = QJsonDocument(root).toJson();
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QFile::WriteOnly) || file.write(json) < 0) {
+            std::fprintf(stderr, "lunaria-bench: failed to write %s\n", qPrintable(parser.value("output")));
+            return 1;
+        }
+    } else {
+        std::fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
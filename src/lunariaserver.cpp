@@ -0,0 +1,108 @@
+// Loads a model once and serves it to local tools over an OpenAI-compatible
+// API, on loopback and/or a Unix socket. See ApiServer for the endpoints and
+// tools/testServer.sh for a scripted client.
+//
+//   lunaria-server --model model.gguf [--port 8080] [--socket /run/user/1000/lunaria.sock]
+//                  [--parallel 4] [--queue 16]
+
+#include "apiserver.h"
+#include "llamaworker.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("lunaria-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("OpenAI-compatible chat completions server for local tools.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"model",           "LLM model (GGUF).", "path"},
+        {"port",            "TCP port on 127.0.0.1, 0 to only use --socket.", "n", "8080"},
+        {"socket",          "Also listen on this Unix socket.", "path"},
+        {"parallel",        "Requests generated at the same time.", "n", "4"},
+        {"queue",           "Requests waiting for a slot before new ones get 429.", "n", "16"},
+        {"ctx",             "Context size shared by all parallel requests, default 2048 each.", "n"},
+        {"threads",         "Decode and prompt processing threads.", "n"},
+        {"batch",           "Batch size.", "n"},
+        {"max-tokens",      "Default max_tokens.", "n", "512"},
+        {"cache-mb",        "Response cache in memory, 0 turns it off.", "n", "64"},
+        {"cache-file",      "Also keep the response cache in this file.", "path"},
+    });
+    parser.process(app);
+
+    if (!parser.isSet("model")) {
+        std::fprintf(stderr, "lunaria-server: --model is required.\n");
+        return 2;
+    }
+
+    const int parallel = std::clamp(parser.value("parallel").toInt(), 1, 64);
+
+    ContextSettings contextSettings;
+    contextSettings.maxSessions = parallel;
+    contextSettings.contextSize = parser.isSet("ctx") ? parser.value("ctx").toInt() : 2048 * parallel;
+    if (parser.isSet("threads")) {
+        contextSettings.threadCount      = parser.value("threads").toInt();
+        contextSettings.batchThreadCount = contextSettings.threadCount;
+    }
+    if (parser.isSet("batch")) {
+        contextSettings.batchSize = parser.value("batch").toInt();
+    }
+    contextSettings.responseCacheMb     = parser.value("cache-mb").toInt();
+    contextSettings.responseCachePath   = parser.value("cache-file");
+
+    QThread thread;
+    thread.setObjectName("LLM Worker");
+    LlamaWorker *worker = new LlamaWorker();
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+
+    ApiServer::Options options;
+    options.maxActive               = parallel;
+    options.maxQueued               = std::max(0, parser.value("queue").toInt());
+    options.modelName               = QFileInfo(parser.value("model")).completeBaseName();
+    options.maxTokensLimit          = contextSettings.contextSize;
+    options.defaults.maxTokens      = std::clamp(parser.value("max-tokens").toInt(), 1, options.maxTokensLimit);
+    ApiServer server(worker, options);
+
+    // Listens only once the model is loaded, so clients can poll /health.
+    QObject::connect(worker, &LlamaWorker::modelLoaded, &app, [&]() {
+        QString error;
+        const quint16 port = parser.value("port").toUShort();
+        if (port != 0 && !server.listenTcp(port, &error)) {
+            std::fprintf(stderr, "lunaria-server: port %u: %s\n", port, qPrintable(error));
+            app.exit(1);
+            return;
+        }
+        if (parser.isSet("socket") && !server.listenLocal(parser.value("socket"), &error)) {
+            std::fprintf(stderr, "lunaria-server: %s: %s\n", qPrintable(parser.value("socket")), qPrintable(error));
+            app.exit(1);
+            return;
+        }
+        std::fprintf(stderr, "lunaria-server: serving %s\n", qPrintable(options.modelName));
+    });
+    QObject::connect(worker, &LlamaWorker::warningOccurred, &app, [](const QString &message) {
+        std::fprintf(stderr, "lunaria-server: warning: %s\n", qPrintable(message));
+    });
+    QObject::connect(worker, &LlamaWorker::errorOccurred, &app, [&](const QString &message) {
+        std::fprintf(stderr, "lunaria-server: %s\n", qPrintable(message));
+        app.exit(1);
+    });
+
+    const QString modelPath = parser.value("model");
+    QMetaObject::invokeMethod(worker, [=]() { worker->loadModel(modelPath, contextSettings); });
+
+    const int status = app.exec();
+
+    worker->requestStop();
+    QMetaObject::invokeMethod(worker, &LlamaWorker::cleanup, Qt::BlockingQueuedConnection);
+    thread.quit();
+    thread.wait();
+    return status;
+}
@@ -0,0 +1,103 @@
+#include "memoryestimate.h"
+#include "gguf.h"
+#include <QFileInfo>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+QString formatBytes(quint64 bytes) {
+    return QString("%1 GiB").arg(bytes / double(1ull << 30), 0, 'f', 2);
+}
+
+// Per-layer values may be stored as one number for all layers or as an array.
+std::vector<quint64> readPerLayer(const gguf_context *gguf, const QString &key, int layers, quint64 fallback) {
+    std::vector<quint64> values(layers, fallback);
+
+    const int64_t id = gguf_find_key(gguf, key.toUtf8().constData());
+    if (id < 0) {
+        return values;
+    }
+
+    if (gguf_get_kv_type(gguf, id) == GGUF_TYPE_ARRAY) {
+        const gguf_type type = gguf_get_arr_type(gguf, id);
+        const size_t n = std::min<size_t>(gguf_get_arr_n(gguf, id), layers);
+        const void *data = gguf_get_arr_data(gguf, id);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (type == GGUF_TYPE_UINT32) {
+                values[i] = static_cast<const uint32_t *>(data)[i];
+            } else if (type == GGUF_TYPE_INT32) {
+                values[i] = std::max<int32_t>(0, static_cast<const int32_t *>(data)[i]);
+            }
+        }
+    } else if (gguf_get_kv_type(gguf, id) == GGUF_TYPE_UINT32) {
+        values.assign(layers, gguf_get_val_u32(gguf, id));
+    } else if (gguf_get_kv_type(gguf, id) == GGUF_TYPE_INT32) {
+        values.assign(layers, std::max<int32_t>(0, gguf_get_val_i32(gguf, id)));
+    }
+    return values;
+}
+
+quint64 readValue(const gguf_context *gguf, const QString &key, quint64 fallback) {
+    return readPerLayer(gguf, key, 1, fallback).front();
+}
+
+} // namespace
+
+ModelShape MemoryEstimate::readShape(const QString &path) {
+    ModelShape shape;
+    shape.weightBytes = QFileInfo(path).size();
+
+    gguf_init_params params = { /*no_alloc=*/ true, /*ctx=*/ nullptr };
+    gguf_context *gguf = gguf_init_from_file(path.toLocal8Bit().constData(), params);
+    if (!gguf) {
+        return shape;
+    }
+
+    const int64_t archId = gguf_find_key(gguf, "general.architecture");
+    if (archId >= 0) {
+        const QString arch = QString::fromUtf8(gguf_get_val_str(gguf, archId));
+
+        const int layers      = readValue(gguf, arch + ".block_count", 0);
+        const quint64 embd    = readValue(gguf, arch + ".embedding_length", 0);
+        const quint64 heads   = readValue(gguf, arch + ".attention.head_count", 0);
+        const quint64 headDim = heads > 0 ? embd / heads : 0;
+        const quint64 keyDim  = readValue(gguf, arch + ".attention.key_length", headDim);
+        const quint64 valDim  = readValue(gguf, arch + ".attention.value_length", headDim);
+
+        // Without grouped-query attention every head has its own K and V.
+        const std::vector<quint64> kvHeads = readPerLayer(gguf, arch + ".attention.head_count_kv", layers, heads);
+
+        shape.layers = layers;
+        for (quint64 n : kvHeads) {
+            shape.kvEmbdK += n * keyDim;
+            shape.kvEmbdV += n * valDim;
+        }
+    }
+
+    gguf_free(gguf);
+    return shape;
+}
+
+quint64 MemoryEstimate::kvBytes(const ModelShape &shape, int n_ctx, ggml_type typeK, ggml_type typeV) {
+    // Per element cost of a quantized type is its block size over elements per block.
+    auto rowBytes = [](ggml_type type, quint64 elements) {
+        return elements * ggml_type_size(type) / ggml_blck_size(type);
+    };
+    return quint64(n_ctx) * (rowBytes(typeK, shape.kvEmbdK) + rowBytes(typeV, shape.kvEmbdV));
+}
+
+ggml_type MemoryEstimate::valueType(int kvCacheType, int flashAttention) {
+    return flashAttention == LLAMA_FLASH_ATTN_TYPE_DISABLED ? GGML_TYPE_F16 : static_cast<ggml_type>(kvCacheType);
+}
+
+QString MemoryEstimate::describe(const ModelShape &shape, int n_ctx, int kvCacheType, int flashAttention) {
+    if (!shape.isValid()) {
+        return QString("Weights %1, KV cache size unknown").arg(formatBytes(shape.weightBytes));
+    }
+
+    const quint64 kv = kvBytes(shape, n_ctx, static_cast<ggml_type>(kvCacheType), valueType(kvCacheType, flashAttention));
+    return QString("Weights %1 + KV cache %2 = %3")
+        .arg(formatBytes(shape.weightBytes), formatBytes(kv), formatBytes(shape.weightBytes + kv));
+}
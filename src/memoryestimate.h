@@ -0,0 +1,32 @@
+#ifndef MEMORYESTIMATE_H
+#define MEMORYESTIMATE_H
+
+#include <QString>
+#include "llama.h"
+
+// What a model needs in memory, read from the GGUF header without loading it.
+struct ModelShape {
+    quint64 weightBytes = 0;            // file size, close to what gets mapped
+    int layers          = 0;
+    quint64 kvEmbdK     = 0;            // K values per token, summed over layers
+    quint64 kvEmbdV     = 0;
+
+    bool isValid() const { return layers > 0; }
+};
+
+class MemoryEstimate
+{
+public:
+    static ModelShape readShape(const QString &path);
+
+    // Upper bound, sliding window and recurrent layers need less.
+    static quint64 kvBytes(const ModelShape &shape, int n_ctx, ggml_type typeK, ggml_type typeV);
+
+    // V can only be quantized when flash attention may be used.
+    static ggml_type valueType(int kvCacheType, int flashAttention);
+
+    // e.g. "Weights 4.07 GiB + KV cache 1.00 GiB = 5.07 GiB"
+    static QString describe(const ModelShape &shape, int n_ctx, int kvCacheType, int flashAttention);
+};
+
+#endif // MEMORYESTIMATE_H
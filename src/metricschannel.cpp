@@ -0,0 +1,29 @@
+#include "metricschannel.h"
+#include <QMutexLocker>
+
+MetricsChannel::MetricsChannel() {
+    clock.start();
+}
+
+void MetricsChannel::setEnabled(bool enabled) {
+    on.store(enabled, std::memory_order_relaxed);
+    if (!enabled) {
+        QMutexLocker lock(&mutex);
+        pending.clear();
+    }
+}
+
+void MetricsChannel::record(Kind kind, double value, double limit) {
+    if (!enabled()) {
+        return;
+    }
+    QMutexLocker lock(&mutex);
+    pending.push_back({kind, clock.elapsed(), value, limit});
+}
+
+std::vector<MetricsChannel::Sample> MetricsChannel::take() {
+    std::vector<Sample> samples;
+    QMutexLocker lock(&mutex);
+    samples.swap(pending);
+    return samples;
+}
@@ -0,0 +1,55 @@
+#ifndef METRICSCHANNEL_H
+#define METRICSCHANNEL_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <atomic>
+#include <vector>
+
+// Carries performance samples from the worker threads to the performance
+// dock. Producers check enabled() first, so while the dock is closed a
+// sample costs one relaxed load and nothing is queued.
+class MetricsChannel
+{
+public:
+    enum Kind {
+        DecodeTps,
+        FirstTokenMs,
+        PrefillTps,
+        KvCells,                // value is cells in use, limit is n_ctx
+        WhisperRtf,
+        ResidentMb,
+        PackageWatts,
+        CpuCelsius,
+        JoulesPerToken,
+        KindCount
+    };
+
+    struct Sample {
+        Kind kind;
+        qint64 timeMs;
+        double value;
+        double limit;
+    };
+
+    MetricsChannel();
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled);
+
+    // Producer side, any thread.
+    void record(Kind kind, double value, double limit = 0.0);
+
+    // Consumer side. Everything recorded since the last call, oldest first.
+    std::vector<Sample> take();
+
+    qint64 elapsedMs() const { return clock.elapsed(); }
+
+private:
+    std::atomic<bool> on{false};
+    QElapsedTimer clock;
+    QMutex mutex;
+    std::vector<Sample> pending;
+};
+
+#endif // METRICSCHANNEL_H
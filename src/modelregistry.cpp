@@ -0,0 +1,106 @@
+#include "modelregistry.h"
+#include <QFileInfo>
+#include <algorithm>
+
+ModelRegistry::~ModelRegistry() {
+    clear();
+}
+
+void ModelRegistry::setBudget(quint64 bytes) {
+    budget = bytes;
+    trim(0);
+}
+
+llama_model *ModelRegistry::acquire(const QString &path, const llama_model_params &params, bool *wasResident) {
+    auto it = std::find_if(entries.begin(), entries.end(), [&](const Entry &entry) {
+        return entry.path == path;
+    });
+
+    if (it != entries.end() && it->users == 0 &&
+        (it->useMmap != params.use_mmap || it->useMlock != params.use_mlock)) {
+        llama_model_free(it->model);
+        entries.erase(it);
+        it = entries.end();
+    }
+
+    if (it != entries.end()) {
+        it->users++;
+        it->lastUsed = ++useCounter;
+        if (wasResident) {
+            *wasResident = true;
+        }
+        return it->model;
+    }
+
+    if (wasResident) {
+        *wasResident = false;
+    }
+
+    // Make room first, so the old and new weights are never both over budget.
+    trim(QFileInfo(path).size());
+
+    llama_model *model = llama_model_load_from_file(path.toStdString().c_str(), params);
+    if (!model) {
+        return nullptr;
+    }
+
+    Entry entry;
+    entry.path      = path;
+    entry.model     = model;
+    entry.useMmap   = params.use_mmap;
+    entry.useMlock  = params.use_mlock;
+    entry.bytes     = llama_model_size(model);
+    entry.lastUsed  = ++useCounter;
+    entry.users     = 1;
+    entries.push_back(entry);
+    return model;
+}
+
+void ModelRegistry::release(llama_model *model) {
+    for (Entry &entry : entries) {
+        if (entry.model == model && entry.users > 0) {
+            entry.users--;
+        }
+    }
+    trim(0);
+}
+
+void ModelRegistry::clear() {
+    for (Entry &entry : entries) {
+        llama_model_free(entry.model);
+    }
+    entries.clear();
+}
+
+std::vector<ResidentModel> ModelRegistry::residentModels() const {
+    std::vector<ResidentModel> models;
+    for (const Entry &entry : entries) {
+        models.push_back({entry.path, entry.bytes, entry.users > 0});
+    }
+    return models;
+}
+
+void ModelRegistry::trim(quint64 incoming) {
+    for (;;) {
+        quint64 total = incoming;
+        for (const Entry &entry : entries) {
+            total += entry.bytes;
+        }
+        if (total <= budget) {
+            return;
+        }
+
+        auto victim = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->users == 0 && (victim == entries.end() || it->lastUsed < victim->lastUsed)) {
+                victim = it;
+            }
+        }
+        if (victim == entries.end()) {
+            return;
+        }
+
+        llama_model_free(victim->model);
+        entries.erase(victim);
+    }
+}
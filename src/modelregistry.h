@@ -0,0 +1,53 @@
+#ifndef MODELREGISTRY_H
+#define MODELREGISTRY_H
+
+#include <QString>
+#include <vector>
+#include "llama.h"
+
+struct ResidentModel {
+    QString path;
+    quint64 bytes       = 0;
+    bool active         = false;
+};
+
+// Keeps loaded models in memory after they are switched away from, so going
+// back to one only needs a new context. Models not in use are evicted least
+// recently used first once their total size exceeds the budget.
+class ModelRegistry
+{
+public:
+    ~ModelRegistry();
+
+    void setBudget(quint64 bytes);
+
+    // Returns the resident model for `path` or loads it. `params` must match
+    // what the resident copy was loaded with, otherwise it is reloaded.
+    llama_model *acquire(const QString &path, const llama_model_params &params, bool *wasResident = nullptr);
+
+    // Marks a model as no longer used by a context, it stays resident within the budget.
+    void release(llama_model *model);
+
+    void clear();
+    std::vector<ResidentModel> residentModels() const;
+
+private:
+    struct Entry {
+        QString path;
+        llama_model *model      = nullptr;
+        bool useMmap            = true;
+        bool useMlock           = false;
+        quint64 bytes           = 0;
+        quint64 lastUsed        = 0;
+        int users               = 0;
+    };
+
+    std::vector<Entry> entries;
+    quint64 budget              = 0;
+    quint64 useCounter          = 0;
+
+    // Evicts unused models until `incoming` more bytes fit in the budget.
+    void trim(quint64 incoming);
+};
+
+#endif // MODELREGISTRY_H
@@ -0,0 +1,142 @@
+#include "performancedock.h"
+#include <QChart>
+#include <QChartView>
+#include <QLineSeries>
+#include <QScrollArea>
+#include <QTimer>
+#include <QValueAxis>
+#include <QVBoxLayout>
+#include <algorithm>
+
+#ifdef __linux__
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+PerformanceDock::PerformanceDock(MetricsChannel *channel, QWidget *parent)
+    : QDockWidget("Performance", parent), channel(channel), timer(new QTimer(this))
+{
+    setObjectName("PerformanceDock");
+
+    auto *content = new QWidget();
+    auto *layout  = new QVBoxLayout(content);
+    layout->addWidget(createPlot(MetricsChannel::DecodeTps,    "Decode (tok/s)",           {"decode"}));
+    layout->addWidget(createPlot(MetricsChannel::FirstTokenMs, "Time to First Token (ms)", {"ttft"}));
+    layout->addWidget(createPlot(MetricsChannel::PrefillTps,   "Prefill (tok/s)",          {"prefill"}));
+    layout->addWidget(createPlot(MetricsChannel::KvCells,      "KV Cache (cells)",         {"used", "n_ctx"}));
+    layout->addWidget(createPlot(MetricsChannel::WhisperRtf,   "Whisper Real-Time Factor", {"rtf"}));
+    layout->addWidget(createPlot(MetricsChannel::ResidentMb,   "Resident Memory (MiB)",    {"rss"}));
+    layout->addWidget(createPlot(MetricsChannel::PackageWatts, "CPU Package Power (W)",    {"power"}));
+    layout->addWidget(createPlot(MetricsChannel::CpuCelsius,   "CPU Temperature (°C)",     {"temp"}));
+    layout->addWidget(createPlot(MetricsChannel::JoulesPerToken, "Energy (J/token)",       {"energy"}));
+
+    auto *scroll = new QScrollArea();
+    scroll->setWidgetResizable(true);
+    scroll->setWidget(content);
+    setWidget(scroll);
+
+    timer->setInterval(REFRESH_MS);
+    connect(timer, &QTimer::timeout,                this, &PerformanceDock::refresh);
+    connect(this,  &QDockWidget::visibilityChanged, this, &PerformanceDock::onVisibilityChanged);
+}
+
+QWidget *PerformanceDock::createPlot(MetricsChannel::Kind kind, const QString &title, const QStringList &names) {
+    Plot &plot  = plots[kind];
+    plot.chart  = new QChart();
+    plot.axisX  = new QValueAxis();
+    plot.axisY  = new QValueAxis();
+
+    plot.chart->setTitle(title);
+    plot.chart->setMargins(QMargins(4, 4, 4, 4));
+    plot.chart->legend()->setVisible(names.size() > 1);
+    plot.axisX->setLabelFormat("%.0fs");
+    plot.axisY->setLabelFormat("%.1f");
+    plot.chart->addAxis(plot.axisX, Qt::AlignBottom);
+    plot.chart->addAxis(plot.axisY, Qt::AlignLeft);
+
+    for (const QString &name : names) {
+        auto *series = new QLineSeries();
+        series->setName(name);
+        plot.chart->addSeries(series);
+        series->attachAxis(plot.axisX);
+        series->attachAxis(plot.axisY);
+        plot.series.push_back(series);
+        plot.points.emplace_back();
+    }
+
+    auto *view = new QChartView(plot.chart);
+    view->setRenderHint(QPainter::Antialiasing);
+    view->setMinimumHeight(160);
+    return view;
+}
+
+void PerformanceDock::onVisibilityChanged(bool visible) {
+    channel->setEnabled(visible);
+    if (visible) {
+        refresh();
+        timer->start();
+    } else {
+        timer->stop();
+    }
+}
+
+void PerformanceDock::refresh() {
+    for (const MetricsChannel::Sample &sample : channel->take()) {
+        const double x = sample.timeMs / 1000.0;
+        append(sample.kind, 0, x, sample.value);
+        if (sample.kind == MetricsChannel::KvCells) {
+            append(sample.kind, 1, x, sample.limit);
+        }
+    }
+
+    // Sampled here rather than by a worker, it belongs to the whole process.
+    append(MetricsChannel::ResidentMb, 0, channel->elapsedMs() / 1000.0, residentMb());
+
+    for (Plot &plot : plots) {
+        if (plot.dirty) {
+            redraw(plot);
+        }
+    }
+}
+
+void PerformanceDock::append(MetricsChannel::Kind kind, int series, double x, double y) {
+    Plot &plot = plots[kind];
+    QList<QPointF> &points = plot.points[series];
+    points.append(QPointF(x, y));
+    if (points.size() > HISTORY) {
+        points.remove(0, points.size() - HISTORY);
+    }
+    plot.dirty = true;
+}
+
+void PerformanceDock::redraw(Plot &plot) {
+    double minX = 0.0, maxX = 1.0, maxY = 1.0;
+    bool first = true;
+    for (size_t i = 0; i < plot.series.size(); ++i) {
+        plot.series[i]->replace(plot.points[i]);
+        for (const QPointF &point : plot.points[i]) {
+            minX = first ? point.x() : std::min(minX, point.x());
+            maxX = first ? point.x() : std::max(maxX, point.x());
+            maxY = std::max(maxY, point.y());
+            first = false;
+        }
+    }
+    plot.axisX->setRange(minX, std::max(maxX, minX + 1.0));
+    plot.axisY->setRange(0.0, maxY * 1.1);
+    plot.dirty = false;
+}
+
+double PerformanceDock::residentMb() {
+#ifdef __linux__
+    FILE *file = std::fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0.0;
+    }
+    long pages = 0, resident = 0;
+    const int n = std::fscanf(file, "%ld %ld", &pages, &resident);
+    std::fclose(file);
+    return n == 2 ? resident * double(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0) : 0.0;
+#else
+    return 0.0;
+#endif
+}
@@ -0,0 +1,53 @@
+#ifndef PERFORMANCEDOCK_H
+#define PERFORMANCEDOCK_H
+
+#include <QDockWidget>
+#include <QList>
+#include <QPointF>
+#include <QStringList>
+#include <vector>
+#include "metricschannel.h"
+
+class QChart;
+class QLineSeries;
+class QTimer;
+class QValueAxis;
+
+// Live graphs of what the workers report through a MetricsChannel. The
+// channel is only enabled while the dock is visible.
+class PerformanceDock : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PerformanceDock(MetricsChannel *channel, QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+    void onVisibilityChanged(bool visible);
+
+private:
+    static constexpr int REFRESH_MS     = 500;
+    static constexpr int HISTORY        = 120;      // points kept per series
+
+    struct Plot {
+        QChart *chart       = nullptr;
+        QValueAxis *axisX   = nullptr;
+        QValueAxis *axisY   = nullptr;
+        std::vector<QLineSeries *> series;
+        std::vector<QList<QPointF>> points;
+        bool dirty          = false;
+    };
+
+    MetricsChannel *channel;
+    QTimer *timer;
+    Plot plots[MetricsChannel::KindCount];
+
+    QWidget *createPlot(MetricsChannel::Kind kind, const QString &title, const QStringList &names);
+    void append(MetricsChannel::Kind kind, int series, double x, double y);
+    void redraw(Plot &plot);
+
+    static double residentMb();
+};
+
+#endif // PERFORMANCEDOCK_H
@@ -0,0 +1,96 @@
+#include "promptlookup.h"
+#include <algorithm>
+
+void PromptLookup::setNgramSize(int size) {
+    size = std::max(size, MIN_NGRAM);
+    if (size != ngramSize) {
+        ngramSize = size;
+        reset();
+    }
+}
+
+void PromptLookup::reset() {
+    tokens.clear();
+    ngrams.assign(ngramSize - MIN_NGRAM + 1, {});
+    indexed = 0;
+}
+
+uint64_t PromptLookup::hashNgram(const llama_token *begin, int n) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < n; ++i) {
+        hash ^= static_cast<uint32_t>(begin[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void PromptLookup::sync(const std::vector<llama_token> &sequence) {
+    if (ngrams.empty()) {
+        reset();
+    }
+     
+    size_t n_same = 0;
+    const size_t n_max = std::min(tokens.size(), sequence.size());
+    while (n_same < n_max && tokens[n_same] == sequence[n_same]) {
+        n_same++;
+    }
+     
+    // Entries may point past the divergence point, rebuild rather than patch them.
+    if (n_same < tokens.size()) {
+        reset();
+        n_same = 0;
+    }
+     
+    tokens.insert(tokens.end(), sequence.begin() + n_same, sequence.end());
+    
+    // An n-gram is only useful once at least one token follows it.
+    if (!tokens.empty()) {
+        indexUpTo(tokens.size() - 1);
+    }
+}
+
+void PromptLookup::indexUpTo(size_t end) {
+    for (; indexed < end; ++indexed) {
+        for (int n = MIN_NGRAM; n <= ngramSize; ++n) {
+            if (indexed + 1 < (size_t) n) {
+                break;
+            }
+            uint64_t key = hashNgram(tokens.data() + indexed + 1 - n, n);
+            ngrams[n - MIN_NGRAM][key] = indexed + 1;
+        }
+    }
+}
+
+std::vector<llama_token> PromptLookup::propose(llama_token last, int n_max) const {
+    std::vector<llama_token> draft;
+    
+    if (n_max <= 0 || ngrams.empty()) {
+        return draft;
+    }
+     
+    // The tail n-gram is the end of the synced sequence followed by `last`.
+    std::vector<llama_token> tail(tokens.end() - std::min<size_t>(tokens.size(), ngramSize - 1), tokens.end());
+    tail.push_back(last);
+     
+    // Longer matches are more likely to continue the same way, try them first.
+    for (int n = std::min<int>(ngramSize, tail.size()); n >= MIN_NGRAM; --n) {
+        const llama_token *ngram = tail.data() + tail.size() - n;
+        const auto &index = ngrams[n - MIN_NGRAM];
+         
+        auto it = index.find(hashNgram(ngram, n));
+        if (it == index.end()) {
+            continue;
+        }
+         
+        size_t pos = it->second;
+        if (!std::equal(ngram, ngram + n, tokens.begin() + pos - n)) {
+            continue;   // hash collision
+        }
+         
+        size_t n_copy = std::min<size_t>(n_max, tokens.size() - pos);
+        draft.assign(tokens.begin() + pos, tokens.begin() + pos + n_copy);
+        break;
+    }
+    
+    return draft;
+}
@@ -0,0 +1,38 @@
+#ifndef PROMPTLOOKUP_H
+#define PROMPTLOOKUP_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "llama.h"
+
+// Draft-free speculation: proposes the continuation of the most recent
+// earlier occurrence of the last few tokens, which is what quote-heavy
+// answers over an injected document mostly consist of.
+class PromptLookup
+{
+public:
+    void setNgramSize(int size);
+    void reset();
+    
+    // Mirrors the evaluated token sequence, re-indexing only what changed.
+    void sync(const std::vector<llama_token> &sequence);
+    
+    // Proposes up to n_max tokens following `last`, which isn't part of the synced sequence yet.
+    std::vector<llama_token> propose(llama_token last, int n_max) const;
+
+private:
+    static constexpr int MIN_NGRAM = 2;
+    
+    int ngramSize = 3;
+    size_t indexed = 0;
+    std::vector<llama_token> tokens;
+    
+    // One index per n-gram size, n-gram hash -> position right after its latest occurrence.
+    std::vector<std::unordered_map<uint64_t, int32_t>> ngrams;
+    
+    static uint64_t hashNgram(const llama_token *begin, int n);
+    void indexUpTo(size_t end);
+};
+
+#endif // PROMPTLOOKUP_H
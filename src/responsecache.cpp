@@ -0,0 +1,202 @@
+#include "responsecache.h"
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+ResponseCache::~ResponseCache() {
+    closeDisk();
+}
+
+void ResponseCache::configure(qint64 memoryBudget, const QString &diskPath, qint64 diskBudget) {
+    this->memoryBudget = std::max<qint64>(0, memoryBudget);
+    this->diskBudget   = std::max<qint64>(0, diskBudget);
+    evict(this->memoryBudget);
+
+    const bool useDisk = enabled() && !diskPath.isEmpty() && this->diskBudget > HEADER_SIZE;
+    if (!useDisk) {
+        closeDisk();
+    } else if (disk.fileName() != diskPath || !disk.isOpen()) {
+        closeDisk();
+        if (!openDisk(diskPath)) {
+            qWarning("Response cache: failed to open %s", qPrintable(diskPath));
+            closeDisk();
+        }
+    } else if (mapSize > this->diskBudget) {
+        resetDisk();
+    }
+    counters.memoryBytes = memoryUsed;
+}
+
+bool ResponseCache::lookup(const QByteArray &key, Entry &entry) {
+    if (!enabled()) {
+        return false;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        lru.splice(lru.begin(), lru, it.value());
+        entry = it.value()->entry;
+    } else {
+        auto found = diskIndex.find(key);
+        if (found == diskIndex.end()) {
+            ++counters.misses;
+            return false;
+        }
+
+        // Copied out of the mapping, the file may be remapped or started
+        // over while the entry is still in use.
+        const uchar *record = map + found.value();
+        entry.generatedTokens = qFromLittleEndian<quint32>(record + KEY_SIZE);
+        const quint32 size    = qFromLittleEndian<quint32>(record + KEY_SIZE + 4);
+        entry.response        = QByteArray(reinterpret_cast<const char *>(record + RECORD_HEADER), size);
+        remember(key, entry);
+    }
+
+    ++counters.hits;
+    counters.bytesSaved  += entry.response.size();
+    counters.tokensSaved += entry.generatedTokens;
+    return true;
+}
+
+void ResponseCache::insert(const QByteArray &key, const Entry &entry) {
+    if (!enabled()) {
+        return;
+    }
+    remember(key, entry);
+    if (disk.isOpen() && !diskIndex.contains(key)) {
+        append(key, entry);
+    }
+}
+
+void ResponseCache::remember(const QByteArray &key, const Entry &entry) {
+    const qint64 size = cost(key, entry);
+    if (size > memoryBudget || index.contains(key)) {
+        return;
+    }
+    evict(memoryBudget - size);
+    lru.push_front({key, entry});
+    index.insert(key, lru.begin());
+    memoryUsed += size;
+    counters.memoryBytes = memoryUsed;
+}
+
+void ResponseCache::evict(qint64 budget) {
+    while (memoryUsed > budget && !lru.empty()) {
+        const Node &node = lru.back();
+        memoryUsed -= cost(node.key, node.entry);
+        index.remove(node.key);
+        lru.pop_back();
+    }
+    counters.memoryBytes = memoryUsed;
+}
+
+qint64 ResponseCache::cost(const QByteArray &key, const Entry &entry) {
+    return key.size() + entry.response.size() + ENTRY_OVERHEAD;
+}
+
+bool ResponseCache::openDisk(const QString &path) {
+    disk.setFileName(path);
+    if (!disk.open(QFile::ReadWrite)) {
+        return false;
+    }
+
+    // Anything that isn't a cache file is left alone rather than overwritten.
+    char header[HEADER_SIZE];
+    if (disk.size() > 0 && (disk.read(header, HEADER_SIZE) != HEADER_SIZE || std::memcmp(header, MAGIC, 4) != 0)) {
+        return false;
+    }
+    if (disk.size() == 0 || qFromLittleEndian<quint32>(header + 4) != VERSION || disk.size() > diskBudget) {
+        resetDisk();
+        return disk.isOpen();
+    }
+
+    if (!remap()) {
+        return false;
+    }
+    scanDisk();
+    return true;
+}
+
+void ResponseCache::closeDisk() {
+    if (map) {
+        disk.unmap(map);
+        map = nullptr;
+    }
+    mapSize = 0;
+    diskIndex.clear();
+    disk.close();
+    counters.diskBytes = 0;
+}
+
+bool ResponseCache::remap() {
+    if (map) {
+        disk.unmap(map);
+        map = nullptr;
+    }
+    mapSize = disk.size();
+    map = disk.map(0, mapSize);
+    counters.diskBytes = mapSize;
+    return map != nullptr;
+}
+
+// Indexes the records, cutting off a partial one left by a crash mid-append.
+void ResponseCache::scanDisk() {
+    qint64 pos = HEADER_SIZE;
+    while (pos + RECORD_HEADER <= mapSize) {
+        const quint32 size = qFromLittleEndian<quint32>(map + pos + KEY_SIZE + 4);
+        if (pos + RECORD_HEADER + size > mapSize) {
+            break;
+        }
+        diskIndex.insert(QByteArray(reinterpret_cast<const char *>(map + pos), KEY_SIZE), pos);
+        pos += RECORD_HEADER + size;
+    }
+
+    if (pos < mapSize) {
+        disk.unmap(map);
+        map = nullptr;
+        disk.resize(pos);
+        remap();
+    }
+}
+
+void ResponseCache::resetDisk() {
+    if (map) {
+        disk.unmap(map);
+        map = nullptr;
+    }
+    diskIndex.clear();
+
+    char header[HEADER_SIZE];
+    std::memcpy(header, MAGIC, 4);
+    qToLittleEndian<quint32>(VERSION, header + 4);
+    if (!disk.resize(0) || !disk.seek(0) || disk.write(header, HEADER_SIZE) != HEADER_SIZE || !disk.flush() || !remap()) {
+        closeDisk();
+    }
+}
+
+void ResponseCache::append(const QByteArray &key, const Entry &entry) {
+    const qint64 size = RECORD_HEADER + entry.response.size();
+    if (HEADER_SIZE + size > diskBudget) {
+        return;
+    }
+    if (mapSize + size > diskBudget) {
+        resetDisk();
+        if (!disk.isOpen()) {
+            return;
+        }
+    }
+
+    char header[RECORD_HEADER];
+    std::memcpy(header, key.constData(), KEY_SIZE);
+    qToLittleEndian<quint32>(entry.generatedTokens, header + KEY_SIZE);
+    qToLittleEndian<quint32>(entry.response.size(), header + KEY_SIZE + 4);
+
+    const qint64 offset = mapSize;
+    if (!disk.seek(offset) || disk.write(header, RECORD_HEADER) != RECORD_HEADER ||
+        disk.write(entry.response) != entry.response.size() || !disk.flush() || !remap()) {
+        qWarning("Response cache: failed to write %s, disk tier disabled", qPrintable(disk.fileName()));
+        closeDisk();
+        return;
+    }
+    diskIndex.insert(key, offset);
+}
@@ -0,0 +1,82 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <list>
+
+// Answers to requests whose output depends only on their input, by a hash of
+// that input. Recently used entries are kept in memory up to a byte budget;
+// optionally every entry is also appended to a memory-mapped file so they
+// survive restarts, and once that file reaches its budget it is started over.
+// Not thread-safe, owned by the worker.
+class ResponseCache
+{
+public:
+    struct Entry {
+        QByteArray response;            // raw UTF-8
+        int generatedTokens = 0;
+    };
+
+    struct Stats {
+        quint64 hits        = 0;
+        quint64 misses      = 0;
+        quint64 bytesSaved  = 0;        // response bytes replayed instead of generated
+        quint64 tokensSaved = 0;
+        qint64 memoryBytes  = 0;
+        qint64 diskBytes    = 0;
+    };
+
+    ~ResponseCache();
+
+    // A memory budget of 0 turns the cache off, an empty path the disk tier.
+    // Entries already cached are kept where the new budgets allow.
+    void configure(qint64 memoryBudget, const QString &diskPath, qint64 diskBudget);
+    bool enabled() const { return memoryBudget > 0; }
+
+    bool lookup(const QByteArray &key, Entry &entry);
+    void insert(const QByteArray &key, const Entry &entry);
+
+    const Stats &stats() const { return counters; }
+
+private:
+    static constexpr char MAGIC[4]      = {'L', 'N', 'R', 'C'};
+    static constexpr quint32 VERSION    = 1;
+    static constexpr qint64 HEADER_SIZE = 8;
+    static constexpr qint64 KEY_SIZE    = 32;       // SHA-256
+    static constexpr qint64 RECORD_HEADER = KEY_SIZE + 8;
+    static constexpr qint64 ENTRY_OVERHEAD = 128;   // node, index and allocation headers
+
+    struct Node {
+        QByteArray key;
+        Entry entry;
+    };
+
+    qint64 memoryBudget     = 0;
+    qint64 memoryUsed       = 0;
+    std::list<Node> lru;                            // most recently used first
+    QHash<QByteArray, std::list<Node>::iterator> index;
+
+    QFile disk;
+    qint64 diskBudget       = 0;
+    uchar *map              = nullptr;
+    qint64 mapSize          = 0;
+    QHash<QByteArray, qint64> diskIndex;            // record offsets
+
+    Stats counters;
+
+    void remember(const QByteArray &key, const Entry &entry);
+    void evict(qint64 budget);
+    static qint64 cost(const QByteArray &key, const Entry &entry);
+
+    bool openDisk(const QString &path);
+    void closeDisk();
+    bool remap();
+    void scanDisk();
+    void resetDisk();
+    void append(const QByteArray &key, const Entry &entry);
+};
+
+#endif // RESPONSECACHE_H
@@ -0,0 +1,91 @@
+// Compares the fused sampler against the stock llama.cpp chain
+// (temp -> top_k -> top_p -> dist) on synthetic logits, no model needed.
+//
+//   lunaria-sampler-bench [n_vocab] [iterations]
+
+#include "fusedsampler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr float TEMPERATURE = 0.7f;
+constexpr int   TOP_K       = 40;
+constexpr float TOP_P       = 0.95f;
+
+template <typename F>
+double microsPerToken(int iterations, F &&sample) {
+    long checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        checksum += sample(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Keeps the loop from being optimised away.
+    if (checksum == -1) {
+        std::puts("");
+    }
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const int n_vocab    = argc > 1 ? std::atoi(argv[1]) : 151936;     // Qwen2.5
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    // A few logit vectors so neither side benefits from a warm branch predictor.
+    std::mt19937 rng(42);
+    std::normal_distribution<float> normal(0.0f, 3.0f);
+    std::vector<std::vector<float>> logits(8, std::vector<float>(n_vocab));
+    for (std::vector<float> &row : logits) {
+        for (float &logit : row) {
+            logit = normal(rng);
+        }
+    }
+
+    // Stock chain, fed the way llama_sampler_sample does: a fresh candidate
+    // array built from the logits for every token.
+    llama_sampler *chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    llama_sampler_chain_add(chain, llama_sampler_init_temp(TEMPERATURE));
+    llama_sampler_chain_add(chain, llama_sampler_init_top_k(TOP_K));
+    llama_sampler_chain_add(chain, llama_sampler_init_top_p(TOP_P, 1));
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(0));
+
+    auto applyChain = [&](int i) {
+        const std::vector<float> &row = logits[i % logits.size()];
+        std::vector<llama_token_data> candidates(n_vocab);
+        for (int id = 0; id < n_vocab; ++id) {
+            candidates[id] = {id, row[id], 0.0f};
+        }
+        llama_token_data_array cur_p = {candidates.data(), candidates.size(), -1, false};
+        llama_sampler_apply(chain, &cur_p);
+        return candidates[cur_p.selected].id;
+    };
+
+    SamplerParams params;
+    params.temperature = TEMPERATURE;
+    params.topK        = TOP_K;
+    params.topP        = TOP_P;
+
+    // The worker calls sample(ctx, idx), which only adds fetching the logits
+    // pointer to this.
+    FusedSampler fused(params);
+
+    const double stock     = microsPerToken(iterations, [&](int i) { return applyChain(i); });
+    const double direct    = microsPerToken(iterations, [&](int i) {
+        return fused.sample(logits[i % logits.size()].data(), n_vocab);
+    });
+
+    std::printf("n_vocab %d, temp %.2f, top_k %d, top_p %.2f, %d iterations\n",
+                n_vocab, TEMPERATURE, TOP_K, TOP_P, iterations);
+    std::printf("  stock chain          %9.1f us/token\n", stock);
+    std::printf("  fused on logits      %9.1f us/token  (%.1fx)\n", direct, stock / direct);
+
+    llama_sampler_free(chain);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "sessionfile.h"
+#include "memoryestimate.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <algorithm>
+
+static const char *FORMAT_NAME = "lunaria-session";
+
+bool SessionFile::save(const QString &path, QString *error) const {
+    QJsonArray messageArray;
+    for (const ChatMessage &message : messages) {
+        QJsonObject entry;
+        entry["role"]    = message.role;
+        entry["content"] = message.content;
+        entry["pinned"]  = message.pinned;
+        messageArray.append(entry);
+    }
+
+    QJsonArray shiftedArray;
+    for (llama_token token : shiftedTokens) {
+        shiftedArray.append(token);
+    }
+
+    QJsonObject root;
+    root["format"]          = FORMAT_NAME;
+    root["version"]         = VERSION;
+    root["model"]           = modelFingerprint;
+    root["context"]         = contextKey;
+    root["tokenCount"]      = tokenCount;
+    root["keepTokens"]      = keepTokens;
+    root["shiftedTokens"]   = shiftedArray;
+    root["messages"]        = messageArray;
+
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit()) {
+        *error = QString("Failed to write %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool SessionFile::load(const QString &path, QString *error) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        *error = QString("Failed to open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        *error = QString("Invalid session file: %1").arg(parseError.errorString());
+        return false;
+    }
+
+    QJsonObject root = document.object();
+    if (root["format"].toString() != FORMAT_NAME) {
+        *error = "Not a Lunaria session file";
+        return false;
+    }
+    if (root["version"].toInt() != VERSION) {
+        *error = QString("Unsupported session file version %1").arg(root["version"].toInt());
+        return false;
+    }
+
+    modelFingerprint    = root["model"].toString();
+    contextKey          = root["context"].toString();
+    tokenCount          = root["tokenCount"].toInt();
+    keepTokens          = root["keepTokens"].toInt();
+
+    shiftedTokens.clear();
+    for (const QJsonValue &value : root["shiftedTokens"].toArray()) {
+        shiftedTokens.push_back(value.toInt());
+    }
+
+    messages.clear();
+    for (const QJsonValue &value : root["messages"].toArray()) {
+        QJsonObject entry = value.toObject();
+        messages.push_back({entry["role"].toString(), entry["content"].toString(), entry["pinned"].toBool()});
+    }
+    return true;
+}
+
+QString SessionFile::statePath(const QString &path) {
+    return path + ".kv";
+}
+
+QString SessionFile::fingerprint(const QString &modelPath) {
+    static const qint64 CHUNK = 1 << 20;
+
+    QFile file(modelPath);
+    if (!file.open(QFile::ReadOnly)) {
+        return QString();
+    }
+
+    const qint64 size = file.size();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(file.read(CHUNK));
+    if (size > CHUNK && file.seek(std::max(CHUNK, size - CHUNK))) {
+        hash.addData(file.read(CHUNK));
+    }
+
+    return QString("%1:%2").arg(size).arg(QString::fromLatin1(hash.result().toHex()));
+}
+
+QString SessionFile::makeContextKey(const ContextSettings &settings) {
+    // Saved KV state holds tensors in the cache's own types.
+    const ggml_type typeK = static_cast<ggml_type>(settings.kvCacheType);
+    const ggml_type typeV = MemoryEstimate::valueType(settings.kvCacheType, settings.flashAttention);
+    return QString("n_ctx=%1 type_k=%2 type_v=%3").arg(settings.contextSize)
+        .arg(QString::fromLatin1(ggml_type_name(typeK)), QString::fromLatin1(ggml_type_name(typeV)));
+}
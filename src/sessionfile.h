@@ -0,0 +1,37 @@
+#ifndef SESSIONFILE_H
+#define SESSIONFILE_H
+
+#include <QString>
+#include <vector>
+#include "llama.h"
+#include "llamaworker.h"
+
+// A saved conversation: a JSON manifest at `path` holding the transcript,
+// plus the sequence's KV state written by llama.cpp next to it. The KV part
+// is only valid for the model file and context layout it was produced with,
+// so both are recorded and compared before it is loaded back.
+struct SessionFile
+{
+    static constexpr int VERSION = 1;
+
+    QString modelFingerprint;
+    QString contextKey;
+    std::vector<ChatMessage> messages;
+    int tokenCount                      = 0;
+    int keepTokens                      = 0;
+    std::vector<llama_token> shiftedTokens;
+
+    bool save(const QString &path, QString *error) const;
+    bool load(const QString &path, QString *error);
+
+    static QString statePath(const QString &path);
+
+    // Size plus SHA-256 of the first and last MiB, hashing multi-GB weights
+    // in full would take longer than the prefill it is meant to save.
+    static QString fingerprint(const QString &modelPath);
+
+    // Context parameters that change the layout of the saved KV state.
+    static QString makeContextKey(const ContextSettings &settings);
+};
+
+#endif // SESSIONFILE_H
@@ -10,6 +10,11 @@
 #include <QDialogButtonBox>
 #include <QFrame>
 #include <QScrollArea>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+#include <algorithm>
 
 SettingsDialog::SettingsDialog(QWidget *parent) : QDialog(parent)
 {
@@ -120,6 +125,25 @@ void SettingsDialog::setupUI()
     topKDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
     generationForm->addRow("", topKDesc);
     
+    keepPartialCheck = new QCheckBox("Keep Partial Answer");
+    keepPartialCheck->setToolTip("Keep what was generated so far in the conversation when a response is stopped");
+    generationForm->addRow("", keepPartialCheck);
+    
+    streamIntervalSpin = new QSpinBox();
+    streamIntervalSpin->setRange(1, 250);
+    streamIntervalSpin->setSingleStep(4);
+    streamIntervalSpin->setSuffix(" ms");
+    generationForm->addRow("Refresh Interval:", streamIntervalSpin);
+    
+    streamTokensSpin = new QSpinBox();
+    streamTokensSpin->setRange(1, 256);
+    streamTokensSpin->setSingleStep(8);
+    generationForm->addRow("Refresh Tokens:", streamTokensSpin);
+    
+    QLabel *streamDesc = new QLabel("Streamed text is shown every interval, or sooner once this many tokens are waiting");
+    streamDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    generationForm->addRow("", streamDesc);
+    
     pdfTruncationSpin = new QSpinBox();
     pdfTruncationSpin->setRange(100, 10000);
     pdfTruncationSpin->setSingleStep(100);
@@ -147,22 +171,302 @@ void SettingsDialog::setupUI()
     contextForm->setLabelAlignment(Qt::AlignRight);
     
     contextSizeSpin = new QSpinBox();
-    contextSizeSpin->setRange(512, 32768);
+    contextSizeSpin->setRange(512, 131072);
     contextSizeSpin->setSingleStep(512);
     contextForm->addRow("Context Size:", contextSizeSpin);
     
+    kvCacheTypeCombo = new QComboBox();
+    kvCacheTypeCombo->addItem("F16", GGML_TYPE_F16);
+    kvCacheTypeCombo->addItem("Q8_0 (half the memory)", GGML_TYPE_Q8_0);
+    kvCacheTypeCombo->addItem("Q4_0 (quarter of the memory)", GGML_TYPE_Q4_0);
+    kvCacheTypeCombo->setToolTip("Quantizing the KV cache allows longer contexts at a small quality cost");
+    contextForm->addRow("KV Cache Type:", kvCacheTypeCombo);
+    
+    flashAttentionCombo = new QComboBox();
+    flashAttentionCombo->addItem("Auto", LLAMA_FLASH_ATTN_TYPE_AUTO);
+    flashAttentionCombo->addItem("On", LLAMA_FLASH_ATTN_TYPE_ENABLED);
+    flashAttentionCombo->addItem("Off", LLAMA_FLASH_ATTN_TYPE_DISABLED);
+    flashAttentionCombo->setToolTip("Needed to quantize the V half of the cache, with it off only K is quantized");
+    contextForm->addRow("Flash Attention:", flashAttentionCombo);
+    
+    memoryEstimateLabel = new QLabel("Load or select a model to see its memory estimate");
+    memoryEstimateLabel->setWordWrap(true);
+    memoryEstimateLabel->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    contextForm->addRow("", memoryEstimateLabel);
+    
+    connect(contextSizeSpin,        &QSpinBox::valueChanged,            this, &SettingsDialog::updateMemoryEstimate);
+    connect(kvCacheTypeCombo,       &QComboBox::currentIndexChanged,    this, &SettingsDialog::updateMemoryEstimate);
+    connect(flashAttentionCombo,    &QComboBox::currentIndexChanged,    this, &SettingsDialog::updateMemoryEstimate);
+    
     batchSizeSpin = new QSpinBox();
     batchSizeSpin->setRange(128, 2048);
     batchSizeSpin->setSingleStep(128);
     contextForm->addRow("Batch Size:", batchSizeSpin);
     
+    maxSessionsSpin = new QSpinBox();
+    maxSessionsSpin->setRange(1, 16);
+    maxSessionsSpin->setSingleStep(1);
+    maxSessionsSpin->setToolTip("Chats that can keep their context cached at the same time");
+    contextForm->addRow("Parallel Chats:", maxSessionsSpin);
+    
+    elasticContextCheck = new QCheckBox("Grow Context on Demand");
+    elasticContextCheck->setToolTip("Start with a small KV cache and double it as chats grow, up to the context size");
+    contextForm->addRow("", elasticContextCheck);
+    
+    const int maxThreads = std::max(32, QThread::idealThreadCount());
+    
     threadCountSpin = new QSpinBox();
-    threadCountSpin->setRange(1, 32);
+    threadCountSpin->setRange(1, maxThreads);
     threadCountSpin->setSingleStep(1);
+    threadCountSpin->setToolTip("Threads used while generating");
     contextForm->addRow("Thread Count:", threadCountSpin);
     
+    batchThreadCountSpin = new QSpinBox();
+    batchThreadCountSpin->setRange(1, maxThreads);
+    batchThreadCountSpin->setSingleStep(1);
+    batchThreadCountSpin->setToolTip("Threads used while processing the prompt");
+    contextForm->addRow("Batch Threads:", batchThreadCountSpin);
+    
+    QLabel *threadDesc = new QLabel(QString("This machine has %1 logical CPUs. Generation is usually fastest with one thread "
+                                            "per physical core, use Tools > Auto-Tune to measure.").arg(QThread::idealThreadCount()));
+    threadDesc->setWordWrap(true);
+    threadDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    contextForm->addRow("", threadDesc);
+    
+    contextShiftCheck = new QCheckBox("Context Shifting");
+    contextShiftCheck->setToolTip("Evict the oldest turns when the context is full instead of stopping");
+    contextForm->addRow("", contextShiftCheck);
+    
+    QLabel *contextShiftDesc = new QLabel("System prompt and few-shot examples are always kept");
+    contextShiftDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    contextForm->addRow("", contextShiftDesc);
+    
+    auto *loadingGroup = new QGroupBox("Model Loading");
+    auto *loadingForm = new QFormLayout(loadingGroup);
+    loadingForm->setHorizontalSpacing(20);
+    loadingForm->setVerticalSpacing(12);
+    loadingForm->setLabelAlignment(Qt::AlignRight);
+    
+    useMmapCheck = new QCheckBox("Memory-Map Model");
+    useMmapCheck->setToolTip("Map the model file instead of reading it into allocated memory");
+    loadingForm->addRow("", useMmapCheck);
+    
+    useMlockCheck = new QCheckBox("Lock Model in RAM");
+    useMlockCheck->setToolTip("Keep the weights resident so they are never paged out");
+    loadingForm->addRow("", useMlockCheck);
+    
+    prefetchCheck = new QCheckBox("Prefetch Model File");
+    prefetchCheck->setToolTip("Read the model file ahead of the loader");
+    loadingForm->addRow("", prefetchCheck);
+    
+    warmupCheck = new QCheckBox("Warmup After Load");
+    warmupCheck->setToolTip("Run a throwaway decode so the first prompt starts fast");
+    loadingForm->addRow("", warmupCheck);
+    
+    residentBudgetSpin = new QSpinBox();
+    residentBudgetSpin->setRange(0, 1 << 20);
+    residentBudgetSpin->setSingleStep(1024);
+    residentBudgetSpin->setSuffix(" MiB");
+    residentBudgetSpin->setToolTip("Models switched away from stay loaded up to this total, least recently used are unloaded first");
+    loadingForm->addRow("Resident Budget:", residentBudgetSpin);
+    
+    QLabel *loadingDesc = new QLabel("Takes effect the next time a model is loaded");
+    loadingDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    loadingForm->addRow("", loadingDesc);
+    
+    auto *placementGroup = new QGroupBox("CPU Placement");
+    auto *placementForm = new QFormLayout(placementGroup);
+    placementForm->setHorizontalSpacing(20);
+    placementForm->setVerticalSpacing(12);
+    placementForm->setLabelAlignment(Qt::AlignRight);
+    
+    computeCoresEdit = new QLineEdit();
+    computeCoresEdit->setPlaceholderText("All cores not used below");
+    computeCoresEdit->setToolTip("Cores for the LLM compute threads, e.g. 0-15 or 0-7,16-23");
+    placementForm->addRow("Compute Cores:", computeCoresEdit);
+    
+    auxCoresEdit = new QLineEdit();
+    auxCoresEdit->setPlaceholderText("All cores not used above");
+    auxCoresEdit->setToolTip("Cores for the interface and speech recognition, so they don't compete with generation");
+    placementForm->addRow("Speech/UI Cores:", auxCoresEdit);
+    
+    numaCombo = new QComboBox();
+    numaCombo->addItem("Disabled", 0);
+    numaCombo->addItem("Distribute", 1);
+    numaCombo->addItem("Isolate", 2);
+    numaCombo->addItem("numactl", 3);
+    numaCombo->setToolTip("Distribute spreads threads over all nodes, Isolate keeps them on the node Lunaria started on, "
+                          "numactl follows the CPU map it was launched with. Overrides the compute core list.");
+    placementForm->addRow("NUMA:", numaCombo);
+    
+    pollLevelSpin = new QSpinBox();
+    pollLevelSpin->setRange(0, 100);
+    pollLevelSpin->setToolTip("0 sleeps between graphs, higher values spin longer for the next one at the cost of idle CPU");
+    placementForm->addRow("Polling:", pollLevelSpin);
+    
+    strictCpuCheck = new QCheckBox("One Core per Thread");
+    strictCpuCheck->setToolTip("Pin each compute thread to its own core instead of letting them move within the set");
+    placementForm->addRow("", strictCpuCheck);
+    
+    QLabel *placementDesc = new QLabel("Takes effect on the next model load, NUMA after a restart");
+    placementDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    placementForm->addRow("", placementDesc);
+    
+    auto *speculativeGroup = new QGroupBox("Speculative Decoding");
+    auto *speculativeForm = new QFormLayout(speculativeGroup);
+    speculativeForm->setHorizontalSpacing(20);
+    speculativeForm->setVerticalSpacing(12);
+    speculativeForm->setLabelAlignment(Qt::AlignRight);
+    
+    draftModelPathEdit = new QLineEdit();
+    draftModelPathEdit->setPlaceholderText("None (disabled)");
+    draftModelPathEdit->setClearButtonEnabled(true);
+    
+    QPushButton *draftBrowseButton = new QPushButton("Browse");
+    connect(draftBrowseButton, &QPushButton::clicked, this, [this]() {
+        QString fileName = QFileDialog::getOpenFileName(
+            this,
+            "Select Draft GGUF Model",
+            draftModelPathEdit->text().isEmpty() ? QDir::homePath() : QFileInfo(draftModelPathEdit->text()).absolutePath(),
+            "GGUF Models (*.gguf);;All Files (*)"
+        );
+        if (!fileName.isEmpty()) {
+            draftModelPathEdit->setText(fileName);
+        }
+    });
+    
+    auto *draftPathLayout = new QHBoxLayout();
+    draftPathLayout->addWidget(draftModelPathEdit);
+    draftPathLayout->addWidget(draftBrowseButton);
+    speculativeForm->addRow("Draft Model:", draftPathLayout);
+    
+    draftTokensSpin = new QSpinBox();
+    draftTokensSpin->setRange(1, 32);
+    draftTokensSpin->setSingleStep(1);
+    speculativeForm->addRow("Draft Tokens:", draftTokensSpin);
+    
+    QLabel *draftDesc = new QLabel("Small model sharing the main model's vocabulary, proposes tokens for the main model to verify");
+    draftDesc->setWordWrap(true);
+    draftDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    speculativeForm->addRow("", draftDesc);
+    
+    promptLookupCheck = new QCheckBox("Prompt Lookup");
+    promptLookupCheck->setToolTip("Propose tokens copied from earlier context, no draft model needed");
+    speculativeForm->addRow("", promptLookupCheck);
+    
+    lookupNgramSpin = new QSpinBox();
+    lookupNgramSpin->setRange(2, 8);
+    lookupNgramSpin->setSingleStep(1);
+    speculativeForm->addRow("Lookup N-gram:", lookupNgramSpin);
+    
+    lookupTokensSpin = new QSpinBox();
+    lookupTokensSpin->setRange(1, 64);
+    lookupTokensSpin->setSingleStep(1);
+    speculativeForm->addRow("Lookup Tokens:", lookupTokensSpin);
+    
+    QLabel *lookupDesc = new QLabel("Speeds up answers that quote uploaded documents");
+    lookupDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    speculativeForm->addRow("", lookupDesc);
+    
+    auto *cacheGroup = new QGroupBox("Response Cache");
+    auto *cacheForm = new QFormLayout(cacheGroup);
+    cacheForm->setHorizontalSpacing(20);
+    cacheForm->setVerticalSpacing(12);
+    cacheForm->setLabelAlignment(Qt::AlignRight);
+    
+    responseCacheSpin = new QSpinBox();
+    responseCacheSpin->setRange(0, 1 << 16);
+    responseCacheSpin->setSingleStep(16);
+    responseCacheSpin->setSuffix(" MiB");
+    responseCacheSpin->setSpecialValueText("Off");
+    responseCacheSpin->setToolTip("Most recently used answers kept in memory");
+    cacheForm->addRow("Memory:", responseCacheSpin);
+    
+    responseCachePathEdit = new QLineEdit();
+    responseCachePathEdit->setPlaceholderText("None (memory only)");
+    responseCachePathEdit->setClearButtonEnabled(true);
+    
+    QPushButton *cacheBrowseButton = new QPushButton("Browse");
+    connect(cacheBrowseButton, &QPushButton::clicked, this, [this]() {
+        QString fileName = QFileDialog::getSaveFileName(
+            this,
+            "Select Response Cache File",
+            responseCachePathEdit->text().isEmpty() ? QDir::homePath() + "/lunaria-responses.cache" : responseCachePathEdit->text(),
+            "Response Cache (*.cache);;All Files (*)",
+            nullptr,
+            QFileDialog::DontConfirmOverwrite
+        );
+        if (!fileName.isEmpty()) {
+            responseCachePathEdit->setText(fileName);
+        }
+    });
+    
+    auto *cachePathLayout = new QHBoxLayout();
+    cachePathLayout->addWidget(responseCachePathEdit);
+    cachePathLayout->addWidget(cacheBrowseButton);
+    cacheForm->addRow("Disk File:", cachePathLayout);
+    
+    responseCacheDiskSpin = new QSpinBox();
+    responseCacheDiskSpin->setRange(1, 1 << 20);
+    responseCacheDiskSpin->setSingleStep(256);
+    responseCacheDiskSpin->setSuffix(" MiB");
+    responseCacheDiskSpin->setToolTip("The file is started over once it reaches this size");
+    cacheForm->addRow("Disk Size:", responseCacheDiskSpin);
+    
+    QLabel *cacheDesc = new QLabel("Repeated questions are answered instantly when the output is deterministic: "
+                                   "temperature 0, or no speculative decoding. Takes effect the next time a model is loaded.");
+    cacheDesc->setWordWrap(true);
+    cacheDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    cacheForm->addRow("", cacheDesc);
+    
+    auto *telemetryGroup = new QGroupBox("Power Telemetry");
+    auto *telemetryForm = new QFormLayout(telemetryGroup);
+    telemetryForm->setHorizontalSpacing(20);
+    telemetryForm->setVerticalSpacing(12);
+    telemetryForm->setLabelAlignment(Qt::AlignRight);
+    
+    telemetryIntervalSpin = new QSpinBox();
+    telemetryIntervalSpin->setRange(0, 60000);
+    telemetryIntervalSpin->setSingleStep(250);
+    telemetryIntervalSpin->setSuffix(" ms");
+    telemetryIntervalSpin->setSpecialValueText("Off");
+    telemetryForm->addRow("Sample Interval:", telemetryIntervalSpin);
+    
+    telemetryLogEdit = new QLineEdit();
+    telemetryLogEdit->setPlaceholderText("None (not logged)");
+    telemetryLogEdit->setClearButtonEnabled(true);
+    
+    QPushButton *telemetryBrowseButton = new QPushButton("Browse");
+    connect(telemetryBrowseButton, &QPushButton::clicked, this, [this]() {
+        QString fileName = QFileDialog::getSaveFileName(
+            this,
+            "Select Telemetry Log",
+            telemetryLogEdit->text().isEmpty() ? QDir::homePath() + "/lunaria-telemetry.jsonl" : telemetryLogEdit->text(),
+            "JSON Lines (*.jsonl);;All Files (*)"
+        );
+        if (!fileName.isEmpty()) {
+            telemetryLogEdit->setText(fileName);
+        }
+    });
+    
+    auto *telemetryLogLayout = new QHBoxLayout();
+    telemetryLogLayout->addWidget(telemetryLogEdit);
+    telemetryLogLayout->addWidget(telemetryBrowseButton);
+    telemetryForm->addRow("Log File:", telemetryLogLayout);
+    
+    QLabel *telemetryDesc = new QLabel("CPU package power from RAPL and temperature from hwmon, shown in the performance panel "
+                                       "along with joules per token. Reading RAPL usually needs root.");
+    telemetryDesc->setWordWrap(true);
+    telemetryDesc->setStyleSheet("color: #666; font-size: 10px; font-style: italic; padding-left: 4px;");
+    telemetryForm->addRow("", telemetryDesc);
+    
     paramsLayout->addWidget(generationGroup);
     paramsLayout->addWidget(contextGroup);
+    paramsLayout->addWidget(loadingGroup);
+    paramsLayout->addWidget(placementGroup);
+    paramsLayout->addWidget(speculativeGroup);
+    paramsLayout->addWidget(cacheGroup);
+    paramsLayout->addWidget(telemetryGroup);
     paramsLayout->addStretch();
     
     // ========== WHISPER SETTINGS TAB ==========
@@ -337,11 +641,40 @@ void SettingsDialog::loadDefaults()
     maxTokensSpin->setValue(512);
     contextSizeSpin->setValue(2048);
     threadCountSpin->setValue(8);
+    batchThreadCountSpin->setValue(8);
     batchSizeSpin->setValue(512);
+    kvCacheTypeCombo->setCurrentIndex(0);
+    flashAttentionCombo->setCurrentIndex(0);
+    maxSessionsSpin->setValue(4);
+    elasticContextCheck->setChecked(false);
+    useMmapCheck->setChecked(true);
+    useMlockCheck->setChecked(false);
+    prefetchCheck->setChecked(true);
+    warmupCheck->setChecked(true);
+    residentBudgetSpin->setValue(16384);
+    computeCoresEdit->clear();
+    auxCoresEdit->clear();
+    numaCombo->setCurrentIndex(0);
+    pollLevelSpin->setValue(50);
+    strictCpuCheck->setChecked(false);
+    draftModelPathEdit->clear();
+    draftTokensSpin->setValue(8);
+    responseCacheSpin->setValue(64);
+    responseCachePathEdit->clear();
+    responseCacheDiskSpin->setValue(1024);
+    promptLookupCheck->setChecked(false);
+    lookupNgramSpin->setValue(3);
+    lookupTokensSpin->setValue(10);
     temperatureSpin->setValue(0.7);
     topPSpin->setValue(0.9);
     topKSpin->setValue(40);
+    keepPartialCheck->setChecked(true);
+    contextShiftCheck->setChecked(true);
     pdfTruncationSpin->setValue(500);
+    streamIntervalSpin->setValue(16);
+    streamTokensSpin->setValue(32);
+    telemetryIntervalSpin->setValue(1000);
+    telemetryLogEdit->clear();
     
     // Whisper defaults
     whisperPrintRealtimeCheck->setChecked(false);
@@ -380,10 +713,106 @@ void SettingsDialog::setThreadCount(int threads) {
     threadCountSpin->setValue(threads);
 }
 
+void SettingsDialog::setBatchThreadCount(int threads) {
+    batchThreadCountSpin->setValue(threads);
+}
+
 void SettingsDialog::setBatchSize(int size) {
     batchSizeSpin->setValue(size);
 }
 
+void SettingsDialog::setKvCacheType(int type) {
+    int index = kvCacheTypeCombo->findData(type);
+    kvCacheTypeCombo->setCurrentIndex(index >= 0 ? index : 0);
+}
+
+void SettingsDialog::setFlashAttention(int mode) {
+    int index = flashAttentionCombo->findData(mode);
+    flashAttentionCombo->setCurrentIndex(index >= 0 ? index : 0);
+}
+
+void SettingsDialog::setModelPath(const QString &path) {
+    modelShape = path.isEmpty() ? ModelShape() : MemoryEstimate::readShape(path);
+    updateMemoryEstimate();
+}
+
+void SettingsDialog::updateMemoryEstimate() {
+    if (modelShape.weightBytes == 0) {
+        return;
+    }
+    memoryEstimateLabel->setText("Estimated memory: " + MemoryEstimate::describe(modelShape, contextSizeSpin->value(),
+                                                                                 getKvCacheType(), getFlashAttention()));
+}
+
+void SettingsDialog::setMaxSessions(int sessions) {
+    maxSessionsSpin->setValue(sessions);
+}
+
+void SettingsDialog::setElasticContext(bool enabled) {
+    elasticContextCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setUseMmap(bool enabled) {
+    useMmapCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setUseMlock(bool enabled) {
+    useMlockCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setPrefetch(bool enabled) {
+    prefetchCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setWarmup(bool enabled) {
+    warmupCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setResidentBudget(int megabytes) {
+    residentBudgetSpin->setValue(megabytes);
+}
+
+void SettingsDialog::setComputeCores(const QString &cores) {
+    computeCoresEdit->setText(cores);
+}
+
+void SettingsDialog::setAuxCores(const QString &cores) {
+    auxCoresEdit->setText(cores);
+}
+
+void SettingsDialog::setNumaStrategy(int strategy) {
+    int index = numaCombo->findData(strategy);
+    numaCombo->setCurrentIndex(index >= 0 ? index : 0);
+}
+
+void SettingsDialog::setPollLevel(int level) {
+    pollLevelSpin->setValue(level);
+}
+
+void SettingsDialog::setStrictCpu(bool enabled) {
+    strictCpuCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setDraftModelPath(const QString &path) {
+    draftModelPathEdit->setText(path);
+}
+
+void SettingsDialog::setDraftTokens(int tokens) {
+    draftTokensSpin->setValue(tokens);
+}
+
+void SettingsDialog::setResponseCacheSize(int megabytes) {
+    responseCacheSpin->setValue(megabytes);
+}
+
+void SettingsDialog::setResponseCachePath(const QString &path) {
+    responseCachePathEdit->setText(path);
+}
+
+void SettingsDialog::setResponseCacheDiskSize(int megabytes) {
+    responseCacheDiskSpin->setValue(megabytes);
+}
+
 void SettingsDialog::setTemperature(double temp) {
     temperatureSpin->setValue(temp);
 }
@@ -396,10 +825,46 @@ void SettingsDialog::setTopK(int k) {
     topKSpin->setValue(k);
 }
 
+void SettingsDialog::setKeepPartial(bool enabled) {
+    keepPartialCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setContextShift(bool enabled) {
+    contextShiftCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setPromptLookup(bool enabled) {
+    promptLookupCheck->setChecked(enabled);
+}
+
+void SettingsDialog::setLookupNgram(int size) {
+    lookupNgramSpin->setValue(size);
+}
+
+void SettingsDialog::setLookupTokens(int tokens) {
+    lookupTokensSpin->setValue(tokens);
+}
+
 void SettingsDialog::setPdfTruncationLength(int length) {
     pdfTruncationSpin->setValue(length);
 }
 
+void SettingsDialog::setStreamInterval(int ms) {
+    streamIntervalSpin->setValue(ms);
+}
+
+void SettingsDialog::setStreamTokens(int tokens) {
+    streamTokensSpin->setValue(tokens);
+}
+
+void SettingsDialog::setTelemetryInterval(int ms) {
+    telemetryIntervalSpin->setValue(ms);
+}
+
+void SettingsDialog::setTelemetryLogPath(const QString &path) {
+    telemetryLogEdit->setText(path);
+}
+
 
 // Setters for LLM
 QString SettingsDialog::getSystemPrompt() const {
@@ -422,10 +887,90 @@ int SettingsDialog::getThreadCount() const {
     return threadCountSpin->value();
 }
 
+int SettingsDialog::getBatchThreadCount() const {
+    return batchThreadCountSpin->value();
+}
+
 int SettingsDialog::getBatchSize() const {
     return batchSizeSpin->value();
 }
 
+int SettingsDialog::getMaxSessions() const {
+    return maxSessionsSpin->value();
+}
+
+int SettingsDialog::getKvCacheType() const {
+    return kvCacheTypeCombo->currentData().toInt();
+}
+
+int SettingsDialog::getFlashAttention() const {
+    return flashAttentionCombo->currentData().toInt();
+}
+
+bool SettingsDialog::getElasticContext() const {
+    return elasticContextCheck->isChecked();
+}
+
+bool SettingsDialog::getUseMmap() const {
+    return useMmapCheck->isChecked();
+}
+
+bool SettingsDialog::getUseMlock() const {
+    return useMlockCheck->isChecked();
+}
+
+bool SettingsDialog::getPrefetch() const {
+    return prefetchCheck->isChecked();
+}
+
+bool SettingsDialog::getWarmup() const {
+    return warmupCheck->isChecked();
+}
+
+int SettingsDialog::getResidentBudget() const {
+    return residentBudgetSpin->value();
+}
+
+QString SettingsDialog::getComputeCores() const {
+    return computeCoresEdit->text().trimmed();
+}
+
+QString SettingsDialog::getAuxCores() const {
+    return auxCoresEdit->text().trimmed();
+}
+
+int SettingsDialog::getNumaStrategy() const {
+    return numaCombo->currentData().toInt();
+}
+
+int SettingsDialog::getPollLevel() const {
+    return pollLevelSpin->value();
+}
+
+bool SettingsDialog::getStrictCpu() const {
+    return strictCpuCheck->isChecked();
+}
+
+QString SettingsDialog::getDraftModelPath() const {
+    return draftModelPathEdit->text().trimmed();
+}
+
+int SettingsDialog::getDraftTokens() const {
+    return draftTokensSpin->value();
+}
+
+int SettingsDialog::getResponseCacheSize() const {
+    return responseCacheSpin->value();
+}
+
+QString SettingsDialog::getResponseCachePath() const {
+    return responseCachePathEdit->text().trimmed();
+}
+
+int SettingsDialog::getResponseCacheDiskSize() const {
+    return responseCacheDiskSpin->value();
+}
+
 double SettingsDialog::getTemperature() const {
     return temperatureSpin->value();
 }
@@ -438,10 +983,46 @@ int SettingsDialog::getTopK() const {
     return topKSpin->value();
 }
 
+bool SettingsDialog::getKeepPartial() const {
+    return keepPartialCheck->isChecked();
+}
+
+bool SettingsDialog::getContextShift() const {
+    return contextShiftCheck->isChecked();
+}
+
+bool SettingsDialog::getPromptLookup() const {
+    return promptLookupCheck->isChecked();
+}
+
+int SettingsDialog::getLookupNgram() const {
+    return lookupNgramSpin->value();
+}
+
+int SettingsDialog::getLookupTokens() const {
+    return lookupTokensSpin->value();
+}
+
 int SettingsDialog::getPdfTruncationLength() const {
     return pdfTruncationSpin->value();
 }
 
+int SettingsDialog::getStreamInterval() const {
+    return streamIntervalSpin->value();
+}
+
+int SettingsDialog::getStreamTokens() const {
+    return streamTokensSpin->value();
+}
+
+int SettingsDialog::getTelemetryInterval() const {
+    return telemetryIntervalSpin->value();
+}
+
+QString SettingsDialog::getTelemetryLogPath() const {
+    return telemetryLogEdit->text().trimmed();
+}
+
 
 // Getters for Whisper
 
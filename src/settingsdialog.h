@@ -8,6 +8,8 @@
 #include <QDoubleSpinBox>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QLabel>
+#include "memoryestimate.h"
 
 struct WhisperSettings;
 
@@ -24,11 +26,40 @@ public:
     int getMaxTokens                () const;
     int getContextSize              () const;
     int getThreadCount              () const;
+    int getBatchThreadCount         () const;
     int getBatchSize                () const;
+    int getKvCacheType              () const;
+    int getFlashAttention           () const;
+    int getMaxSessions              () const;
+    bool getElasticContext          () const;
+    bool getUseMmap                 () const;
+    bool getUseMlock                () const;
+    bool getPrefetch                () const;
+    bool getWarmup                  () const;
+    int getResidentBudget           () const;
+    QString getComputeCores         () const;
+    QString getAuxCores             () const;
+    int getNumaStrategy             () const;
+    int getPollLevel                () const;
+    bool getStrictCpu               () const;
+    QString getDraftModelPath       () const;
+    int getDraftTokens              () const;
+    int getResponseCacheSize        () const;
+    QString getResponseCachePath    () const;
+    int getResponseCacheDiskSize    () const;
     double getTemperature           () const;
     double getTopP                  () const;
     int getTopK                     () const;
+    bool getKeepPartial             () const;
+    bool getContextShift            () const;
+    bool getPromptLookup            () const;
+    int getLookupNgram              () const;
+    int getLookupTokens             () const;
     int getPdfTruncationLength      () const;
+    int getStreamInterval           () const;
+    int getStreamTokens             () const;
+    int getTelemetryInterval        () const;
+    QString getTelemetryLogPath     () const;
     
     // Whisper getters
     bool getWhisperPrintRealtime    () const;
@@ -51,11 +82,41 @@ public:
     void setMaxTokens               (int tokens);
     void setContextSize             (int size);
     void setThreadCount             (int threads);
+    void setBatchThreadCount        (int threads);
     void setBatchSize               (int size);
+    void setKvCacheType             (int type);
+    void setFlashAttention          (int mode);
+    void setModelPath               (const QString &path);
+    void setMaxSessions             (int sessions);
+    void setElasticContext          (bool enabled);
+    void setUseMmap                 (bool enabled);
+    void setUseMlock                (bool enabled);
+    void setPrefetch                (bool enabled);
+    void setWarmup                  (bool enabled);
+    void setResidentBudget          (int megabytes);
+    void setComputeCores            (const QString &cores);
+    void setAuxCores                (const QString &cores);
+    void setNumaStrategy            (int strategy);
+    void setPollLevel               (int level);
+    void setStrictCpu               (bool enabled);
+    void setDraftModelPath          (const QString &path);
+    void setDraftTokens             (int tokens);
+    void setResponseCacheSize       (int megabytes);
+    void setResponseCachePath       (const QString &path);
+    void setResponseCacheDiskSize   (int megabytes);
     void setTemperature             (double temp);
     void setTopP                    (double p);
     void setTopK                    (int k);
+    void setKeepPartial             (bool enabled);
+    void setContextShift            (bool enabled);
+    void setPromptLookup            (bool enabled);
+    void setLookupNgram             (int size);
+    void setLookupTokens            (int tokens);
     void setPdfTruncationLength     (int length);
+    void setStreamInterval          (int ms);
+    void setStreamTokens            (int tokens);
+    void setTelemetryInterval       (int ms);
+    void setTelemetryLogPath        (const QString &path);
     
     // Whisper setters
     void setWhisperPrintRealtime    (bool value);
@@ -78,11 +139,41 @@ private:
     QSpinBox                        *maxTokensSpin;
     QSpinBox                        *contextSizeSpin;
     QSpinBox                        *threadCountSpin;
+    QSpinBox                        *batchThreadCountSpin;
     QSpinBox                        *batchSizeSpin;
+    QComboBox                       *kvCacheTypeCombo;
+    QComboBox                       *flashAttentionCombo;
+    QLabel                          *memoryEstimateLabel;
+    QSpinBox                        *maxSessionsSpin;
+    QCheckBox                       *elasticContextCheck;
+    QCheckBox                       *useMmapCheck;
+    QCheckBox                       *useMlockCheck;
+    QCheckBox                       *prefetchCheck;
+    QCheckBox                       *warmupCheck;
+    QSpinBox                        *residentBudgetSpin;
+    QLineEdit                       *computeCoresEdit;
+    QLineEdit                       *auxCoresEdit;
+    QComboBox                       *numaCombo;
+    QSpinBox                        *pollLevelSpin;
+    QCheckBox                       *strictCpuCheck;
+    QLineEdit                       *draftModelPathEdit;
+    QSpinBox                        *draftTokensSpin;
+    QSpinBox                        *responseCacheSpin;
+    QLineEdit                       *responseCachePathEdit;
+    QSpinBox                        *responseCacheDiskSpin;
+    QCheckBox                       *promptLookupCheck;
+    QSpinBox                        *lookupNgramSpin;
+    QSpinBox                        *lookupTokensSpin;
     QDoubleSpinBox                  *temperatureSpin;
     QDoubleSpinBox                  *topPSpin;
     QSpinBox                        *topKSpin;
+    QCheckBox                       *keepPartialCheck;
+    QCheckBox                       *contextShiftCheck;
     QSpinBox                        *pdfTruncationSpin;
+    QSpinBox                        *streamIntervalSpin;
+    QSpinBox                        *streamTokensSpin;
+    QSpinBox                        *telemetryIntervalSpin;
+    QLineEdit                       *telemetryLogEdit;
      
     QCheckBox                       *whisperPrintRealtimeCheck;
     QCheckBox                       *whisperPrintProgressCheck;
@@ -98,7 +189,10 @@ private:
     QCheckBox                       *whisperSplitOnWordCheck;
     QCheckBox                       *whisperSuppressBlankCheck;
     
+    ModelShape                      modelShape;
+    
     void setupUI();
+    void updateMemoryEstimate();
     void loadDefaults();
 };
 
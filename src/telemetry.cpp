@@ -0,0 +1,165 @@
+#include "telemetry.h"
+#include <QDateTime>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+const QString POWERCAP_DIR  = "/sys/class/powercap";
+const QString HWMON_DIR     = "/sys/class/hwmon";
+
+// hwmon drivers that report the CPU package or cores.
+const QStringList CPU_SENSORS = {"coretemp", "k10temp", "zenpower", "cpu_thermal", "soc_thermal"};
+
+bool readValue(const QString &path, quint64 &value) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    bool ok = false;
+    value = file.readAll().trimmed().toULongLong(&ok);
+    return ok;
+}
+
+QString readText(const QString &path) {
+    QFile file(path);
+    return file.open(QFile::ReadOnly) ? QString::fromUtf8(file.readAll()).trimmed() : QString();
+}
+
+} // namespace
+
+EnergyCounter::EnergyCounter() {
+    // Top-level zones only (intel-rapl:N, not intel-rapl:N:M), the subzones
+    // are already part of their package. psys covers more than the CPU.
+    const QStringList zones = QDir(POWERCAP_DIR).entryList({"intel-rapl:*"}, QDir::Dirs);
+    for (const QString &zone : zones) {
+        if (zone.count(':') != 1) {
+            continue;
+        }
+        const QString dir = POWERCAP_DIR + "/" + zone;
+        if (readText(dir + "/name") == "psys") {
+            continue;
+        }
+
+        Domain domain;
+        domain.path = dir + "/energy_uj";
+        if (readValue(domain.path, domain.last) && readValue(dir + "/max_energy_range_uj", domain.range)) {
+            domains.push_back(domain);
+        }
+    }
+}
+
+quint64 EnergyCounter::microjoules() {
+    QMutexLocker lock(&mutex);
+    for (Domain &domain : domains) {
+        quint64 value;
+        if (!readValue(domain.path, value)) {
+            continue;
+        }
+        total += value >= domain.last ? value - domain.last : domain.range - domain.last + value;
+        domain.last = value;
+    }
+    return total;
+}
+
+TelemetrySampler::TelemetrySampler(EnergyCounter *energy, MetricsChannel *metrics, QObject *parent)
+    : QObject(parent), energy(energy), metrics(metrics), timer(new QTimer(this))
+{
+    const QStringList chips = QDir(HWMON_DIR).entryList({"hwmon*"}, QDir::Dirs);
+    for (const QString &chip : chips) {
+        const QDir dir(HWMON_DIR + "/" + chip);
+        if (!CPU_SENSORS.contains(readText(dir.filePath("name")))) {
+            continue;
+        }
+        for (const QString &input : dir.entryList({"temp*_input"}, QDir::Files)) {
+            temperatureInputs.push_back(dir.filePath(input));
+        }
+    }
+
+    connect(timer, &QTimer::timeout, this, &TelemetrySampler::sample);
+    clock.start();
+}
+
+void TelemetrySampler::start(int intervalMs, const QString &logPath) {
+    timer->stop();
+
+    if (log.fileName() != logPath || !log.isOpen()) {
+        log.close();
+        log.setFileName(logPath);
+        if (!logPath.isEmpty() && !log.open(QFile::WriteOnly | QFile::Append | QFile::Text)) {
+            qWarning("Failed to open telemetry log %s", qPrintable(logPath));
+        }
+    }
+
+    if (intervalMs > 0 && (energy->available() || !temperatureInputs.empty())) {
+        lastMicrojoules = energy->microjoules();
+        lastNs          = clock.nsecsElapsed();
+        timer->start(intervalMs);
+    }
+}
+
+void TelemetrySampler::sample() {
+    const quint64 microjoules = energy->microjoules();
+    const qint64 ns           = clock.nsecsElapsed();
+    const double seconds      = (ns - lastNs) / 1e9;
+    const double watts        = energy->available() && seconds > 0.0 ? (microjoules - lastMicrojoules) / 1e6 / seconds : -1.0;
+    const double celsius      = temperature();
+    lastMicrojoules = microjoules;
+    lastNs          = ns;
+
+    if (metrics) {
+        if (watts >= 0.0) {
+            metrics->record(MetricsChannel::PackageWatts, watts);
+        }
+        if (celsius >= 0.0) {
+            metrics->record(MetricsChannel::CpuCelsius, celsius);
+        }
+    }
+
+    if (log.isOpen()) {
+        QJsonObject entry;
+        entry["timeMs"] = QDateTime::currentMSecsSinceEpoch();
+        if (watts >= 0.0) {
+            entry["watts"] = watts;
+        }
+        if (celsius >= 0.0) {
+            entry["celsius"] = celsius;
+        }
+        writeLog(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+    }
+}
+
+void TelemetrySampler::logGeneration(int generatedTokens, double joules, qint64 durationMs) {
+    if (!log.isOpen() || generatedTokens <= 0 || joules <= 0.0) {
+        return;
+    }
+    QJsonObject entry;
+    entry["timeMs"]             = QDateTime::currentMSecsSinceEpoch();
+    entry["generatedTokens"]    = generatedTokens;
+    entry["durationMs"]         = durationMs;
+    entry["joules"]             = joules;
+    entry["joulesPerToken"]     = joules / generatedTokens;
+    entry["tokensPerWatt"]      = generatedTokens / joules;     // tok/s per W is tokens per joule
+    writeLog(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+}
+
+double TelemetrySampler::temperature() const {
+    double hottest = -1.0;
+    for (const QString &input : temperatureInputs) {
+        quint64 millidegrees;
+        if (readValue(input, millidegrees)) {
+            hottest = std::max(hottest, millidegrees / 1000.0);
+        }
+    }
+    return hottest;
+}
+
+void TelemetrySampler::writeLog(const QByteArray &line) {
+    log.write(line);
+    log.write("\n");
+    log.flush();
+}
@@ -0,0 +1,71 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <vector>
+#include "metricschannel.h"
+
+class QTimer;
+
+// CPU package energy from the RAPL powercap counters. The counters wrap, so
+// every read folds the difference since the last one into a running total.
+// Thread-safe. Recent kernels only let root read them, without access
+// available() is false.
+class EnergyCounter
+{
+public:
+    EnergyCounter();
+
+    bool available() const { return !domains.empty(); }
+
+    // Running total since construction.
+    quint64 microjoules();
+
+private:
+    struct Domain {
+        QString path;
+        quint64 last    = 0;
+        quint64 range   = 0;            // value the counter wraps at
+    };
+
+    QMutex mutex;
+    std::vector<Domain> domains;
+    quint64 total = 0;
+};
+
+// Samples package power and the hottest CPU sensor at a fixed rate on its own
+// thread, for the performance dock and, optionally, a JSON Lines log. Sensors
+// are hwmon chips that belong to the CPU.
+class TelemetrySampler : public QObject
+{
+    Q_OBJECT
+
+public:
+    TelemetrySampler(EnergyCounter *energy, MetricsChannel *metrics, QObject *parent = nullptr);
+
+public slots:
+    // An interval of 0 stops sampling, an empty path stops logging.
+    void start(int intervalMs, const QString &logPath);
+    void logGeneration(int generatedTokens, double joules, qint64 durationMs);
+
+private:
+    EnergyCounter *energy;
+    MetricsChannel *metrics;
+    QTimer *timer;
+    QFile log;
+    std::vector<QString> temperatureInputs;
+
+    QElapsedTimer clock;
+    quint64 lastMicrojoules = 0;
+    qint64 lastNs           = 0;
+
+    void sample();
+    double temperature() const;
+    void writeLog(const QByteArray &line);
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,110 @@
+#include "tokenstream.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+
+TokenStream::TokenStream(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring.resize(size);
+    mask = size - 1;
+}
+
+void TokenStream::setThreshold(int tokens) {
+    threshold = std::max(1, tokens);
+}
+
+bool TokenStream::write(int sessionId, const char *data, int size) {
+    const uint16_t length = std::min(size, 0xffff);
+    const int32_t id = sessionId;
+
+    char header[HEADER];
+    std::memcpy(header, &id, sizeof(id));
+    std::memcpy(header + sizeof(id), &length, sizeof(length));
+
+    const size_t n = HEADER + length;
+    const size_t h = head.load(std::memory_order_relaxed);
+
+    if (!spillPending.load(std::memory_order_acquire) &&
+        ring.size() - (h - tail.load(std::memory_order_acquire)) >= n) {
+        copyIn(h, header, HEADER);
+        copyIn(h + HEADER, data, length);
+        head.store(h + n, std::memory_order_release);
+    } else {
+        QMutexLocker lock(&spillMutex);
+        spill.append(header, HEADER);
+        spill.append(data, length);
+        spillPending.store(true, std::memory_order_release);
+    }
+
+    return unread.fetch_add(1, std::memory_order_relaxed) + 1 == threshold.load(std::memory_order_relaxed);
+}
+
+void TokenStream::drain(const std::function<void(int sessionId, const QString &text)> &sink) {
+    unread.store(0, std::memory_order_relaxed);
+
+    // Checked before reading `head`: once the spill is in use the producer stops
+    // writing to the ring, so every ring record is older than the spilled ones.
+    const bool spilled = spillPending.load(std::memory_order_acquire);
+
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+
+    std::string records(h - t, '\0');
+    copyOut(t, records.data(), records.size());
+    tail.store(h, std::memory_order_release);
+
+    if (spilled) {
+        QMutexLocker lock(&spillMutex);
+        records += spill;
+        spill.clear();
+        spillPending.store(false, std::memory_order_release);
+    }
+
+    if (records.empty()) {
+        return;
+    }
+
+    std::map<int, std::string> pieces;
+    parseRecords(records, pieces);
+
+    for (const auto &entry : pieces) {
+        auto it = decoders.try_emplace(entry.first, QStringDecoder::Utf8).first;
+        QString text = it->second(QByteArrayView(entry.second.data(), entry.second.size()));
+        if (!text.isEmpty()) {
+            sink(entry.first, text);
+        }
+    }
+}
+
+void TokenStream::reset(int sessionId) {
+    decoders.erase(sessionId);
+}
+
+void TokenStream::copyIn(size_t pos, const char *data, size_t size) {
+    const size_t offset = pos & mask;
+    const size_t first = std::min(size, ring.size() - offset);
+    std::memcpy(ring.data() + offset, data, first);
+    std::memcpy(ring.data(), data + first, size - first);
+}
+
+void TokenStream::copyOut(size_t pos, char *data, size_t size) const {
+    const size_t offset = pos & mask;
+    const size_t first = std::min(size, ring.size() - offset);
+    std::memcpy(data, ring.data() + offset, first);
+    std::memcpy(data + first, ring.data(), size - first);
+}
+
+void TokenStream::parseRecords(const std::string &records, std::map<int, std::string> &pieces) {
+    size_t pos = 0;
+    while (pos + HEADER <= records.size()) {
+        int32_t id;
+        uint16_t length;
+        std::memcpy(&id, records.data() + pos, sizeof(id));
+        std::memcpy(&length, records.data() + pos + sizeof(id), sizeof(length));
+        pieces[id].append(records, pos + HEADER, length);
+        pos += HEADER + length;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include <QString>
+#include <QStringDecoder>
+#include <QMutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Carries streamed token text from the worker thread to the GUI thread
+// without a queued signal per token. The worker appends raw UTF-8 pieces to a
+// lock-free single-producer/single-consumer ring, the GUI drains it on a timer
+// and decodes per session, so multi-byte characters split across tokens are
+// only shown once complete.
+class TokenStream
+{
+public:
+    explicit TokenStream(size_t capacity = 1 << 16);
+
+    // Producer side. Returns true once every `threshold` tokens since the
+    // last drain, so the worker can nudge the GUI instead of waiting for its timer.
+    bool write(int sessionId, const char *data, int size);
+    void setThreshold(int tokens);
+
+    // Consumer side. Calls `sink` once per session with everything decoded so far.
+    void drain(const std::function<void(int sessionId, const QString &text)> &sink);
+
+    // Consumer side. Drops any incomplete character left over from a session.
+    void reset(int sessionId);
+
+private:
+    static constexpr size_t HEADER = sizeof(int32_t) + sizeof(uint16_t);
+
+    std::vector<char> ring;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};    // advanced by the producer
+    alignas(64) std::atomic<size_t> tail{0};    // advanced by the consumer
+    alignas(64) std::atomic<int> unread{0};
+    std::atomic<int> threshold{32};
+
+    // Records that didn't fit while the GUI was busy. Once used, everything goes
+    // here until the consumer takes it, which keeps records in order.
+    QMutex spillMutex;
+    std::atomic<bool> spillPending{false};
+    std::string spill;
+
+    std::map<int, QStringDecoder> decoders;
+
+    void copyIn(size_t pos, const char *data, size_t size);
+    void copyOut(size_t pos, char *data, size_t size) const;
+    static void parseRecords(const std::string &records, std::map<int, std::string> &pieces);
+};
+
+#endif // TOKENSTREAM_H
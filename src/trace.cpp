@@ -0,0 +1,136 @@
+#include "trace.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t RING_SIZE = 1 << 15;    // events per thread, a power of two
+
+struct Event {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// A seqlock per slot: `stamp` is 2i + 1 while event i is being written and
+// 2i + 2 once it is complete, so a reader can tell a finished event from one
+// the writer lapped or is halfway through. The fields are atomics so the
+// racing read is well defined, relaxed stores cost the same as plain ones.
+struct Slot {
+    std::atomic<uint64_t> stamp{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> end{0};
+};
+
+// Written only by its own thread, read by dump() from any thread.
+struct Ring {
+    int tid = 0;
+    QString threadName;
+    std::unique_ptr<Slot[]> events{new Slot[RING_SIZE]};
+    std::atomic<uint64_t> head{0};
+};
+
+QMutex registryMutex;
+std::vector<std::unique_ptr<Ring>> registry;    // rings outlive their threads so they can still be dumped
+thread_local Ring *localRing = nullptr;
+
+Ring *threadRing() {
+    if (!localRing) {
+        auto ring = std::make_unique<Ring>();
+        ring->threadName = QThread::currentThread()->objectName();
+
+        QMutexLocker lock(&registryMutex);
+        ring->tid = registry.size() + 1;
+        if (ring->threadName.isEmpty()) {
+            ring->threadName = QString("Thread %1").arg(ring->tid);
+        }
+        localRing = ring.get();
+        registry.push_back(std::move(ring));
+    }
+    return localRing;
+}
+
+} // namespace
+
+uint64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *name, uint64_t startNs, uint64_t endNs) {
+    Ring *ring = threadRing();
+    const uint64_t h = ring->head.load(std::memory_order_relaxed);
+    Slot &slot = ring->events[h & (RING_SIZE - 1)];
+    slot.stamp.store(2 * h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(startNs, std::memory_order_relaxed);
+    slot.end.store(endNs, std::memory_order_relaxed);
+    slot.stamp.store(2 * h + 2, std::memory_order_release);
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+bool Trace::dump(const QString &path, QString *error) {
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+
+    auto append = [&](const QByteArray &event) {
+        if (!first) {
+            json += ",\n";
+        }
+        json += event;
+        first = false;
+    };
+
+    QMutexLocker lock(&registryMutex);
+    for (const std::unique_ptr<Ring> &ring : registry) {
+        const uint64_t head  = ring->head.load(std::memory_order_acquire);
+        const uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+
+        // A slot the thread reused or is still writing while it is copied
+        // fails the stamp check and is skipped.
+        std::vector<Event> events;
+        events.reserve(head - begin);
+        for (uint64_t i = begin; i < head; ++i) {
+            const Slot &slot = ring->events[i & (RING_SIZE - 1)];
+            const uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+            const Event event = {slot.name.load(std::memory_order_relaxed),
+                                 slot.start.load(std::memory_order_relaxed),
+                                 slot.end.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stamp == 2 * i + 2 && slot.stamp.load(std::memory_order_relaxed) == stamp) {
+                events.push_back(event);
+            }
+        }
+
+        QString name = ring->threadName;
+        name.replace('"', '\'');
+        append(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}")
+               .arg(pid).arg(ring->tid).arg(name).toUtf8());
+
+        for (const Event &event : events) {
+            append(QString("{\"name\":\"%1\",\"ph\":\"X\",\"pid\":%2,\"tid\":%3,\"ts\":%4,\"dur\":%5}")
+                   .arg(QString::fromLatin1(event.name)).arg(pid).arg(ring->tid)
+                   .arg(event.start / 1000.0, 0, 'f', 3)
+                   .arg((event.end - event.start) / 1000.0, 0, 'f', 3).toUtf8());
+        }
+    }
+    lock.unlock();
+
+    json += "\n]}\n";
+
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly) || file.write(json) < 0 || !file.commit()) {
+        *error = QString("Failed to write %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+// Scoped spans for finding where a slow turn spent its time. Each thread
+// records into its own ring, newest events overwriting the oldest, and
+// dump() writes whatever the rings hold as Chrome trace JSON, which
+// Perfetto and chrome://tracing open directly. Off by default; while off
+// a span costs one relaxed load.
+class Trace
+{
+public:
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+
+    // Span names must be string literals, only the pointer is stored.
+    static void record(const char *name, uint64_t startNs, uint64_t endNs);
+    static bool dump(const QString &path, QString *error);
+
+    static uint64_t now();
+
+private:
+    static inline std::atomic<bool> on{false};
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *label)
+        : name(Trace::enabled() ? label : nullptr), start(name ? Trace::now() : 0) {}
+
+    ~TraceSpan() {
+        if (name) {
+            Trace::record(name, start, Trace::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,29 @@
+#include "vocabpieces.h"
+
+void VocabPieces::build(const llama_vocab *vocab) {
+    clear();
+
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    arena.reserve(size_t(n_vocab) * 8);
+    offsets.reserve(n_vocab + 1);
+    offsets.push_back(0);
+
+    std::vector<char> buf(256);
+    for (llama_token id = 0; id < n_vocab; ++id) {
+        // Special tokens are rendered too, same as streaming did before.
+        int n = llama_token_to_piece(vocab, id, buf.data(), buf.size(), 0, true);
+        if (n < 0) {
+            buf.resize(-n);
+            n = llama_token_to_piece(vocab, id, buf.data(), buf.size(), 0, true);
+        }
+        if (n > 0) {
+            arena.insert(arena.end(), buf.begin(), buf.begin() + n);
+        }
+        offsets.push_back(arena.size());
+    }
+}
+
+void VocabPieces::clear() {
+    arena.clear();
+    offsets.clear();
+}
@@ -0,0 +1,30 @@
+#ifndef VOCABPIECES_H
+#define VOCABPIECES_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "llama.h"
+
+// The UTF-8 text of every token, rendered once at model load into one
+// contiguous arena, so detokenizing a generated token is a lookup rather
+// than a llama.cpp call into a scratch buffer.
+class VocabPieces
+{
+public:
+    void build(const llama_vocab *vocab);
+    void clear();
+
+    int size() const { return offsets.empty() ? 0 : int(offsets.size()) - 1; }
+
+    // Points into the arena, valid until the next build() or clear().
+    std::string_view piece(llama_token id) const {
+        return std::string_view(arena.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+private:
+    std::vector<char> arena;
+    std::vector<uint32_t> offsets;      // piece i is [offsets[i], offsets[i + 1])
+};
+
+#endif // VOCABPIECES_H
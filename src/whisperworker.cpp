@@ -1,5 +1,7 @@
 #include "whisperworker.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include "trace.h"
 
 WhisperWorker::WhisperWorker(QObject *parent)
     : QObject(parent)
@@ -16,6 +18,7 @@ WhisperWorker::~WhisperWorker()
 
 void WhisperWorker::loadModel(const QString &modelPath)
 {
+    TraceSpan span("whisper.loadModel");
     try {
         if (ctx) {
             whisper_free(ctx);
@@ -71,12 +74,24 @@ void WhisperWorker::transcribe(const std::vector<float> &audioData, const Whispe
         wparams.split_on_word = settings.splitOnWord;
         wparams.suppress_blank = settings.suppressBlank;
          
-        int result = whisper_full(ctx, wparams, audioData.data(), audioData.size());
+        QElapsedTimer timer;
+        timer.start();
+        
+        int result;
+        {
+            TraceSpan span("whisper.full");
+            result = whisper_full(ctx, wparams, audioData.data(), audioData.size());
+        }
         
         if (result != 0) {
             emit errorOccurred("Whisper transcription failed");
             return;
         }
+        
+        if (metrics) {
+            const double audioSeconds = double(audioData.size()) / WHISPER_SAMPLE_RATE;
+            metrics->record(MetricsChannel::WhisperRtf, timer.elapsed() / 1000.0 / audioSeconds);
+        }
          
         QString transcription;
         const int n_segments = whisper_full_n_segments(ctx);
@@ -5,6 +5,7 @@
 #include <QString>
 #include <vector>
 #include "whisper.h"
+#include "metricschannel.h"
 
 struct WhisperSettings {
     bool printRealtime;
@@ -30,6 +31,9 @@ public:
     explicit WhisperWorker(QObject *parent = nullptr);
     ~WhisperWorker();
 
+    // Optional, set before the worker thread starts.
+    void setMetrics(MetricsChannel *channel) { metrics = channel; }
+
 public slots:
     void loadModel(const QString &modelPath);
     void transcribe(const std::vector<float> &audioData, const WhisperSettings &settings);   
@@ -42,6 +46,7 @@ signals:
 private:
     whisper_context *ctx = nullptr;
     bool isModelLoaded = false;
+    MetricsChannel *metrics = nullptr;
 };
 
 #endif // WHISPERWORKER_H
\ No newline at end of file
@@ -5,7 +5,7 @@ CXX_FLAGS="$C_FLAGS"
 
 cmake .. -G Ninja \
 -DGGML_CUDA=OFF \
--DGGML_OPENMP=ON \
+-DGGML_OPENMP=OFF \
 -DCMAKE_BUILD_TYPE=Release \
 -DCMAKE_C_FLAGS="$C_FLAGS" \
 -DCMAKE_CXX_FLAGS="$CXX_FLAGS" \
@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+# Starts lunaria-server on localhost and checks it with curl: plain and
+# streamed completions over TCP and the Unix socket, queue overflow (429),
+# cancellation when a streaming client hangs up, and response cache replays.
+#
+#   MODEL=models/model.gguf ./tools/testServer.sh [path/to/lunaria-server]
+
+set -u
+
+SERVER="${1:-./build_Lunaria/lunaria-server}"
+MODEL="${MODEL:?set MODEL to a GGUF model}"
+PORT="${PORT:-18080}"
+SOCKET="${SOCKET:-/tmp/lunaria-test-$$.sock}"
+BASE="http://127.0.0.1:$PORT"
+FAILED=0
+
+pass() { echo "PASS  $1"; }
+fail() { echo "FAIL  $1"; FAILED=1; }
+
+"$SERVER" --model "$MODEL" --port "$PORT" --socket "$SOCKET" --parallel 2 --queue 2 --max-tokens 16 &
+PID=$!
+trap 'kill $PID 2>/dev/null; wait $PID 2>/dev/null; rm -f "$SOCKET"' EXIT
+
+for _ in $(seq 600); do
+    curl -sf "$BASE/health" >/dev/null && break
+    kill -0 $PID 2>/dev/null || { echo "server exited"; exit 1; }
+    sleep 0.5
+done
+
+BODY='{"messages":[{"role":"user","content":"Say hello."}],"max_tokens":8}'
+SHORT_STREAM_BODY='{"messages":[{"role":"user","content":"Say hello."}],"max_tokens":8,"stream":true}'
+STREAM_BODY='{"messages":[{"role":"user","content":"Count from one to fifty."}],"max_tokens":200,"stream":true}'
+# Sent once only, a cached replay would finish before the client hangs up.
+CANCEL_BODY='{"messages":[{"role":"user","content":"Count from fifty down to one."}],"max_tokens":200,"stream":true}'
+CACHE_BODY='{"messages":[{"role":"user","content":"Name three colors."}],"max_tokens":16}'
+
+cache_hits() { curl -sf "$BASE/health" | grep -o '"hits":[0-9]*' | cut -d: -f2; }
+content() { sed -n 's/.*"message":{"content":"\(.*\)","role".*/\1/p'; }
+
+# Plain completion
+OUT=$(curl -sf "$BASE/v1/chat/completions" -H 'Content-Type: application/json' -d "$BODY")
+echo "$OUT" | grep -q '"object":"chat.completion"' && echo "$OUT" | grep -q '"completion_tokens"' \
+    && pass "completion" || fail "completion: $OUT"
+
+# Streamed completion ends with [DONE]
+OUT=$(curl -sfN "$BASE/v1/chat/completions" -H 'Content-Type: application/json' -d "$SHORT_STREAM_BODY")
+echo "$OUT" | grep -q '"chat.completion.chunk"' && echo "$OUT" | tail -n 2 | grep -q 'data: \[DONE\]' \
+    && pass "stream" || fail "stream: $OUT"
+
+# Unix socket
+OUT=$(curl -sf --unix-socket "$SOCKET" "http://localhost/v1/chat/completions" -d "$BODY")
+echo "$OUT" | grep -q '"chat.completion"' && pass "unix socket" || fail "unix socket: $OUT"
+
+# Models and errors
+curl -sf "$BASE/v1/models" | grep -q '"object":"list"' && pass "models" || fail "models"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' "$BASE/v1/chat/completions" -d '{"messages":[]}')
+[ "$CODE" = 400 ] && pass "bad request" || fail "bad request: $CODE"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' "$BASE/v1/chat/completions" \
+    -d '{"messages":[{"role":"user","content":"Hi."}],"max_tokens":2000000000}')
+[ "$CODE" = 400 ] && pass "max_tokens over the context" || fail "max_tokens over the context: $CODE"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' "$BASE/nope")
+[ "$CODE" = 404 ] && pass "not found" || fail "not found: $CODE"
+
+# 2 active + 2 queued fit, the rest of 8 concurrent requests are refused
+CODES=$(for _ in $(seq 8); do
+    curl -s -o /dev/null -w '%{http_code}\n' "$BASE/v1/chat/completions" -d "$STREAM_BODY" &
+done; wait)
+OK=$(echo "$CODES" | grep -c '^200$')
+BUSY=$(echo "$CODES" | grep -c '^429$')
+[ "$OK" -ge 4 ] && [ "$BUSY" -ge 1 ] && [ $((OK + BUSY)) = 8 ] \
+    && pass "queue limit ($OK served, $BUSY refused)" || fail "queue limit: $CODES"
+
+# A client hanging up mid-stream frees its slot
+curl -sN --max-time 1 "$BASE/v1/chat/completions" -d "$CANCEL_BODY" >/dev/null
+sleep 1
+OUT=$(curl -sf "$BASE/health")
+echo "$OUT" | grep -q '"active":0' && pass "cancel on disconnect" || fail "cancel on disconnect: $OUT"
+
+# The same request twice is answered from the response cache the second time
+HITS=$(cache_hits)
+FIRST=$(curl -sf "$BASE/v1/chat/completions" -d "$CACHE_BODY" | content)
+SECOND=$(curl -sf "$BASE/v1/chat/completions" -d "$CACHE_BODY" | content)
+AFTER=$(cache_hits)
+[ -n "$FIRST" ] && [ "$FIRST" = "$SECOND" ] && [ "${AFTER:-0}" -gt "${HITS:-0}" ] \
+    && pass "response cache ($HITS -> $AFTER hits)" || fail "response cache: hits $HITS -> $AFTER, '$FIRST' vs '$SECOND'"
+
+exit $FAILED